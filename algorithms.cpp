@@ -2,6 +2,11 @@
 #include <utility>
 #include <queue>
 #include "algorithms.h"
+#include "parallel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using std::queue;
 using std::vector;
@@ -29,7 +34,7 @@ namespace algorithms
     }
 
     QImage hysteresis(const QImage& image, double tmin, double tmax) {
-        auto res = QImage(image.size(), image.format());
+        QImage res = pooledImage(image.size(), image.format());
         res.fill(0x00);
 
         const quint8 *original_line;
@@ -81,9 +86,45 @@ namespace algorithms
     }
 
 
-    QImage canny(const QImage& input, double sigma, double tmin, double tmax) {
-        // Gaussian blur
-        QImage res = convolution(getGaussianKernel(sigma), input);
+    // Keep only pixels that are local maxima of the magnitude along the gradient direction.
+    // Neighbours are read from the magnitude before suppression, so a pixel
+    // only depends on its 3x3 neighbourhood and rows are independent.
+    void nonMaximumSuppression(QImage& res, const QImage& gx, const QImage& gy) {
+        const QImage mag = pooledCopy(res, res.rect());
+
+        const ImageRows resRows(res);
+        parallelBands(res.height() - 2, [&](int begin, int end) {
+            quint8 *out;
+            const quint8 *line, *prev_line, *next_line, *gx_line, *gy_line;
+
+            for (int y = begin + 1; y < end + 1; y++) {
+                out = resRows[y];
+                line = mag.constScanLine(y);
+                prev_line = mag.constScanLine(y - 1);
+                next_line = mag.constScanLine(y + 1);
+                gx_line = gx.constScanLine(y);
+                gy_line = gy.constScanLine(y);
+
+                for (int x = 1; x < res.width() - 1; x++) {
+                    double at = atan2(gy_line[x], gx_line[x]);
+                    const double dir = fmod(at + M_PI, M_PI) / M_PI * 8;
+
+                    if ((1 >= dir || dir > 7) && line[x - 1] < line[x] && line[x + 1] < line[x] ||
+                        (1 < dir || dir <= 3) && prev_line[x - 1] < line[x] && next_line[x + 1] < line[x] ||
+                        (3 < dir || dir <= 5) && prev_line[x] < line[x] && next_line[x] < line[x] ||
+                        (5 < dir || dir <= 7) && prev_line[x + 1] < line[x] && next_line[x - 1] < line[x])
+                        continue;
+
+                    out[x] = 0x00;
+                }
+            }
+        });
+    }
+
+
+    QImage canny(const QImage& input, double sigma, double tmin, double tmax, Smoothing smoothing) {
+        // Gaussian blur, or median/bilateral to keep edges of noisy scans
+        QImage res = smooth(input, smoothing, sigma);
 
         // Gradients
         QImage gx = convolution(sobelx, res);
@@ -94,29 +135,7 @@ namespace algorithms
         magnitude(res, gx, gy);
 
         // Non-maximum suppression
-        quint8 *line;
-        const quint8 *prev_line, *next_line, *gx_line, *gy_line;
-
-        for (int y = 1; y < res.height() - 1; y++) {
-            line = res.scanLine(y);
-            prev_line = res.constScanLine(y - 1);
-            next_line = res.constScanLine(y + 1);
-            gx_line = gx.constScanLine(y);
-            gy_line = gy.constScanLine(y);
-
-            for (int x = 1; x < res.width() - 1; x++) {
-                double at = atan2(gy_line[x], gx_line[x]);
-                const double dir = fmod(at + M_PI, M_PI) / M_PI * 8;
-
-                if ((1 >= dir || dir > 7) && line[x - 1] < line[x] && line[x + 1] < line[x] ||
-                    (1 < dir || dir <= 3) && prev_line[x - 1] < line[x] && next_line[x + 1] < line[x] ||
-                    (3 < dir || dir <= 5) && prev_line[x] < line[x] && next_line[x] < line[x] ||
-                    (5 < dir || dir <= 7) && prev_line[x + 1] < line[x] && next_line[x - 1] < line[x])
-                    continue;
-
-                line[x] = 0x00;
-            }
-        }
+        nonMaximumSuppression(res, gx, gy);
 
         // Hysteresis
         return hysteresis(res, tmin, tmax);
@@ -124,30 +143,236 @@ namespace algorithms
 
 
     QImage sobel(const QImage& input) {
-        QImage res(input.size(), input.format());
+        QImage res = pooledImage(input.size(), input.format());
         magnitude(res, convolution(sobelx, input), convolution(sobely, input));
         return res;
     }
 
 
     QImage prewitt(const QImage& input) {
-        QImage res(input.size(), input.format());
+        QImage res = pooledImage(input.size(), input.format());
         magnitude(res, convolution(prewittx, input), convolution(prewitty, input));
         return res;
     }
 
     QImage roberts(const QImage& input) {
-        QImage res(input.size(), input.format());
+        QImage res = pooledImage(input.size(), input.format());
         magnitude(res, convolution(robertsx, input), convolution(robertsy, input));
         return res;
     }
 
 
     QImage scharr(const QImage& input) {
-        QImage res(input.size(), input.format());
+        QImage res = pooledImage(input.size(), input.format());
         magnitude(res, convolution(scharrx, input), convolution(scharry, input));
         return res;
     }
-}
 
 
+    // well mixed 32-bit hash, so neighbouring pixels get unrelated dice
+    static inline quint32 mixBits(quint32 h) {
+        h ^= h >> 16;
+        h *= 0x7feb352dU;
+        h ^= h >> 15;
+        h *= 0x846ca68bU;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // Replace random pixels (about one in five) by the mean of their 7x7 neighbourhood.
+    // A pixel is picked by a hash of the seed and its image position
+    // (input.offset() is the position of a tile), so tiles of one image give
+    // the same result as the whole image. Palette images come back as RGB32
+    // or ARGB32, quantizing them again would pick a palette per tile.
+    QImage randomBlur(const QImage& input, quint32 seed) {
+        const int radius = 3;
+        const QImage rgb = input.convertToFormat(QImage::Format_RGB32);
+        const int width = rgb.width();
+        const int height = rgb.height();
+        const QPoint origin = input.offset();
+
+        // a deep copy, the bands write to it in parallel; alpha is kept
+        QImage res = pooledCopy(input.hasAlphaChannel() ? input.convertToFormat(QImage::Format_ARGB32) : rgb,
+                                input.rect());
+
+        // Every band keeps the sums of the window rows per column and slides
+        // them down one row at a time; along a row the window sum slides the
+        // same way over the column sums. 7 * 7 * 255 fits 32 bits easily.
+        const ImageRows resRows(res);
+        parallelBands(height, [&](int begin, int end) {
+            PooledArray<quint32> columns(size_t(width) * 3);
+            columns.fill(0);
+
+            auto addRow = [&](int y, quint32 sign) {
+                const QRgb *line = reinterpret_cast<const QRgb*>(rgb.constScanLine(y));
+                for (int x = 0; x < width; x++) {
+                    columns[3 * x] += sign * qRed(line[x]);
+                    columns[3 * x + 1] += sign * qGreen(line[x]);
+                    columns[3 * x + 2] += sign * qBlue(line[x]);
+                }
+            };
+
+            for (int y = qMax(0, begin - radius); y < qMin(height, begin + radius); y++) {
+                addRow(y, 1);
+            }
+
+            for (int y = begin; y < end; y++) {
+                if (y + radius < height)
+                    addRow(y + radius, 1);
+                if (y > begin && y - radius - 1 >= 0)
+                    addRow(y - radius - 1, quint32(-1));
+
+                const int rows = qMin(height - 1, y + radius) - qMax(0, y - radius) + 1;
+                const quint32 position = mixBits(quint32(origin.y() + y) ^ mixBits(seed));
+                QRgb *dst = reinterpret_cast<QRgb*>(resRows[y]);
+
+                quint32 sum[3] = { 0, 0, 0 };
+                for (int x = 0; x < qMin(radius, width); x++) {
+                    for (int c = 0; c < 3; c++) {
+                        sum[c] += columns[3 * x + c];
+                    }
+                }
+
+                for (int x = 0; x < width; x++) {
+                    for (int c = 0; c < 3; c++) {
+                        if (x + radius < width)
+                            sum[c] += columns[3 * (x + radius) + c];
+                        if (x - radius - 1 >= 0)
+                            sum[c] -= columns[3 * (x - radius - 1) + c];
+                    }
+
+                    if (mixBits(quint32(origin.x() + x) ^ position) % 5 != 0)
+                        continue;
+
+                    const quint32 count = rows * (qMin(width - 1, x + radius) - qMax(0, x - radius) + 1);
+                    dst[x] = qRgba(sum[0] / count, sum[1] / count, sum[2] / count, qAlpha(dst[x]));
+                }
+            }
+        });
+
+        if (res.format() != input.format() && !isPaletteImage(input))
+            return res.convertToFormat(input.format());
+        return res;
+    }
+
+
+    // Luminance with the same weights as qGray(), eight pixels at a time
+    void rgbToLuma(const QRgb* src, quint8* dst, int count) {
+        int x = 0;
+
+#ifdef __SSE2__
+        const __m128i mask = _mm_set1_epi32(0xFF);
+        const __m128i wr = _mm_set1_epi16(11);
+        const __m128i wg = _mm_set1_epi16(16);
+        const __m128i wb = _mm_set1_epi16(5);
+        for (; x + 8 <= count; x += 8) {
+            __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+            __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x + 4));
+
+            // deinterleave into 16-bit lanes per channel
+            __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),
+                                        _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+            __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),
+                                        _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+            __m128i b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+
+            __m128i luma = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, wr), _mm_mullo_epi16(g, wg)),
+                                         _mm_mullo_epi16(b, wb));
+            luma = _mm_srli_epi16(luma, 5);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(luma, luma));
+        }
+#endif
+
+        for (; x < count; x++) {
+            dst[x] = qGray(src[x]);
+        }
+    }
+
+
+    // Canny on multichannel images (Di Zenzo): the per-channel gradients are
+    // combined into a structure tensor, whose largest eigenvalue gives the edge
+    // strength and whose eigenvector gives the direction for suppression.
+    QImage cannyColor(const QImage& input, double sigma, double tmin, double tmax, Smoothing smoothing) {
+        const QImage image = toByteChannels(input);
+
+        // per channel smoothing, in one pass over the interleaved data
+        QImage blurred = smooth(image, smoothing, sigma);
+
+        const int width = blurred.width();
+        const int height = blurred.height();
+        const int channels = blurred.depth() / 8;
+        const int alpha = channels == 4 ? alphaByteIndex() : -1;
+        const int colors = alpha >= 0 ? channels - 1 : channels;
+
+        QImage mag = pooledImage(blurred.size(), QImage::Format_Grayscale8);
+        QImage dir = pooledImage(blurred.size(), QImage::Format_Grayscale8);
+        mag.fill(0x00);
+
+        const ImageRows magRows(mag), dirRows(dir);
+        parallelBands(height - 2, [&](int begin, int end) {
+            for (int y = begin + 1; y < end + 1; y++) {
+                const quint8 *prev_line = blurred.constScanLine(y - 1);
+                const quint8 *line = blurred.constScanLine(y);
+                const quint8 *next_line = blurred.constScanLine(y + 1);
+                quint8 *mag_line = magRows[y];
+                quint8 *dir_line = dirRows[y];
+
+                for (int x = 1; x < width - 1; x++) {
+                    double gxx = 0, gyy = 0, gxy = 0;
+
+                    for (int c = 0; c < channels; c++) {
+                        if (c == alpha)
+                            continue;
+                        const int l = (x - 1) * channels + c;
+                        const int m = x * channels + c;
+                        const int r = (x + 1) * channels + c;
+
+                        // sobel, y pointing down
+                        const int gx = (prev_line[r] + 2 * line[r] + next_line[r])
+                                     - (prev_line[l] + 2 * line[l] + next_line[l]);
+                        const int gy = (next_line[l] + 2 * next_line[m] + next_line[r])
+                                     - (prev_line[l] + 2 * prev_line[m] + prev_line[r]);
+                        gxx += gx * gx;
+                        gyy += gy * gy;
+                        gxy += gx * gy;
+                    }
+
+                    const double lambda = 0.5 * (gxx + gyy + std::sqrt((gxx - gyy) * (gxx - gyy) + 4 * gxy * gxy));
+                    mag_line[x] = qBound(0x00, static_cast<int>(std::sqrt(lambda / colors)), 0xFF);
+
+                    // quantize the gradient direction to 0, 45, 90 or 135 degrees
+                    double theta = 0.5 * atan2(2 * gxy, gxx - gyy);
+                    if (theta < 0)
+                        theta += M_PI;
+                    dir_line[x] = static_cast<int>(std::floor(theta / (M_PI / 4) + 0.5)) % 4;
+                }
+            }
+        });
+
+        // Non-maximum suppression along the quantized direction
+        static const int dx[4] = { 1, 1, 0, -1 };
+        static const int dy[4] = { 0, 1, 1, 1 };
+        QImage res = pooledImage(mag.size(), QImage::Format_Grayscale8);
+        res.fill(0x00);
+
+        const ImageRows resRows(res);
+        parallelBands(height - 2, [&](int begin, int end) {
+            for (int y = begin + 1; y < end + 1; y++) {
+                const quint8 *mag_line = mag.constScanLine(y);
+                const quint8 *dir_line = dir.constScanLine(y);
+                quint8 *line = resRows[y];
+
+                for (int x = 1; x < width - 1; x++) {
+                    const int d = dir_line[x];
+                    const quint8 ahead = mag.constScanLine(y + dy[d])[x + dx[d]];
+                    const quint8 behind = mag.constScanLine(y - dy[d])[x - dx[d]];
+                    if (mag_line[x] > ahead && mag_line[x] >= behind)
+                        line[x] = mag_line[x];
+                }
+            }
+        });
+
+        // Hysteresis
+        return hysteresis(res, tmin, tmax);
+    }
+}
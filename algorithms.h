@@ -2,41 +2,154 @@
 #define ALGORITHMS_H
 
 #include <cmath>
+#include <vector>
 #include "kernels.h"
+#include "bufferpool.h"
+#include "denoise.h"
+#include "parallel.h"
 
 namespace algorithms
 {
     void magnitude(QImage&, const QImage&, const QImage&);
-    QImage canny(const QImage&, double, double, double);
+    void nonMaximumSuppression(QImage&, const QImage&, const QImage&);
+    QImage canny(const QImage&, double, double, double, Smoothing = Smoothing::Gaussian);
     QImage sobel(const QImage&);
     QImage prewitt(const QImage&);
     QImage roberts(const QImage&);
     QImage scharr(const QImage&);
     QImage hysteresis(const QImage&, double, double);
+    QImage randomBlur(const QImage&, quint32);
+    QImage cannyColor(const QImage&, double, double, double, Smoothing = Smoothing::Gaussian);
+    // src holds QRgb values, see isQRgbImage()
+    void rgbToLuma(const QRgb*, quint8*, int);
 
+    // true when every pixel is a 0xAARRGGBB QRgb value (alpha not premultiplied)
+    inline bool isQRgbImage(const QImage& image) {
+        return image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32;
+    }
+
+    // true when pixels are indices into the colour table
+    inline bool isPaletteImage(const QImage& image) {
+        return image.format() == QImage::Format_Indexed8 || image.format() == QImage::Format_Mono
+                || image.format() == QImage::Format_MonoLSB;
+    }
+
+    // true when every byte of a pixel is one channel, as the per channel
+    // filters read them: Grayscale8 and the 32-bit 8888 layouts
+    inline bool isByteChannelImage(const QImage& image) {
+        return image.format() == QImage::Format_Grayscale8 || isQRgbImage(image)
+                || image.format() == QImage::Format_RGBA8888;
+    }
+
+    // image as it is when isByteChannelImage(), otherwise converted to ARGB32
+    // or RGB32; palette, packed and premultiplied pixels are not channels
+    inline QImage toByteChannels(const QImage& image) {
+        if (isByteChannelImage(image))
+            return image;
+        return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    }
+
+    // position of the alpha byte of a 32-bit pixel in memory
+    inline int alphaByteIndex() {
+        return QSysInfo::ByteOrder == QSysInfo::LittleEndian ? 3 : 0;
+    }
+
+    template<class T>
+    QImage convolution(const Matrix<T>& kernel, const QImage& input) {
+        const QImage image = toByteChannels(input);
+        QImage out = pooledImage(image.size(), image.format());
+        int kw = kernel[0].size();
+        int kh = kernel.size();
+        int offsetx = kw / 2;
+        int offsety = kh / 2;
+
+        // interleaved formats are filtered per channel in the same pass,
+        // the alpha byte of 32-bit formats is copied through
+        const int channels = image.depth() / 8;
+        const int alpha = channels == 4 ? alphaByteIndex() : -1;
+
+        // output rows are independent, filter them in parallel bands
+        const ImageRows outRows(out);
+        parallelBands(image.height(), [&](int begin, int end) {
+            double sum[4];
+            quint8 *line;
+            const quint8 *lookup_line;
+
+            for (int y = begin; y < end; y++) {
+                line = outRows[y];
+                for (int x = 0; x < image.width(); x++) {
+                    for (int c = 0; c < channels; c++) {
+                        sum[c] = 0;
+                    }
+
+                    for (int j = 0; j < kh; j++) {
+                        if (y + j < offsety || y + j - offsety >= image.height())
+                            continue;
+                        lookup_line = image.constScanLine(y + j - offsety);
+                        for (int i = 0; i < kw; i++) {
+                            if (x + i < offsetx || x + i - offsetx >= image.width())
+                                continue;
+                            const quint8 *pixel = lookup_line + (x + i - offsetx) * channels;
+                            for (int c = 0; c < channels; c++) {
+                                sum[c] += kernel[j][i] * pixel[c];
+                            }
+                        }
+                    }
+
+                    quint8 *dst = line + x * channels;
+                    for (int c = 0; c < channels; c++) {
+                        dst[c] = qBound(0x00, static_cast<int>(sum[c]), 0xFF);
+                    }
+                    if (alpha >= 0) {
+                        dst[alpha] = image.constScanLine(y)[x * channels + alpha];
+                    }
+                }
+            }
+        });
+
+        return out;
+    }
+
+    // Convolution of the luminance of an RGB32 or ARGB32 image. Source rows
+    // are converted to luma once each into a small ring buffer, instead of
+    // converting the whole image to Grayscale8 first. Other formats are
+    // converted to RGB32 first.
     template<class T>
-    QImage convolution(const Matrix<T>& kernel, const QImage& image) {
-        QImage out(image.size(), image.format());
+    QImage lumaConvolution(const Matrix<T>& kernel, const QImage& input) {
+        const QImage image = isQRgbImage(input) ? input : input.convertToFormat(QImage::Format_RGB32);
+        QImage out = pooledImage(image.size(), QImage::Format_Grayscale8);
         int kw = kernel[0].size();
         int kh = kernel.size();
         int offsetx = kw / 2;
-        int offsety = kw / 2;
+        int offsety = kh / 2;
+        const int width = image.width();
         double sum;
 
+        std::vector<quint8> rows(size_t(kh) * width);
+        std::vector<int> cached(kh, -1);
+        auto lumaLine = [&](int sy) -> const quint8* {
+            quint8 *row = rows.data() + size_t(sy % kh) * width;
+            if (cached[sy % kh] != sy) {
+                rgbToLuma(reinterpret_cast<const QRgb*>(image.constScanLine(sy)), row, width);
+                cached[sy % kh] = sy;
+            }
+            return row;
+        };
+
         quint8 *line;
         const quint8 *lookup_line;
 
         for (int y = 0; y < image.height(); y++) {
             line = out.scanLine(y);
-            for (int x = 0; x < image.width(); x++) {
+            for (int x = 0; x < width; x++) {
                 sum = 0;
 
                 for (int j = 0; j < kh; j++) {
-                    if (y + j < offsety || y + j >= image.height())
+                    if (y + j < offsety || y + j - offsety >= image.height())
                         continue;
-                    lookup_line = image.constScanLine(y + j - offsety);
+                    lookup_line = lumaLine(y + j - offsety);
                     for (int i = 0; i < kw; i++) {
-                        if (x + i < offsetx || x + i >= image.width())
+                        if (x + i < offsetx || x + i - offsetx >= width)
                             continue;
                         sum += kernel[j][i] * lookup_line[x + i - offsetx];
                     }
@@ -0,0 +1,126 @@
+#include "bandprinter.h"
+#include <QPrinter>
+#include <QProgressDialog>
+#include <QtConcurrent>
+#include <QtMath>
+#include "resampler.h"
+#include "tone.h"
+
+#ifndef QT_NO_PRINTER
+
+BandPrinter::BandPrinter(QPrinter *printer, const QImage& image, int rotateAngle,
+                         const QVector<quint8>& lut, QWidget *parent) :
+    QObject(parent), m_printer(printer), m_image(image), m_lut(lut), m_rotateAngle(rotateAngle),
+    m_scale(1), m_bands(0), m_current(0), m_canceled(false)
+{
+    // maps source pixels to the rotated image, including the translation back to (0, 0)
+    QTransform rotate;
+    rotate.rotate(m_rotateAngle);
+    m_rotation = QImage::trueMatrix(rotate, image.width(), image.height());
+    m_rotatedSize = m_rotation.mapRect(image.rect()).size();
+
+    // fit the page keeping the aspect ratio, centered like QGraphicsScene::render does
+    QRect page(QPoint(0, 0), printer->pageRect().size());
+    m_scale = qMin(double(page.width()) / m_rotatedSize.width(),
+                   double(page.height()) / m_rotatedSize.height());
+    QSize target(qMax(1, qRound(m_rotatedSize.width() * m_scale)),
+                 qMax(1, qRound(m_rotatedSize.height() * m_scale)));
+    m_target = QRect(QPoint((page.width() - target.width()) / 2,
+                            (page.height() - target.height()) / 2), target);
+    m_bands = (target.height() + BandHeight - 1) / BandHeight;
+
+    m_progress = new QProgressDialog(tr("Printing..."), tr("Cancel"), 0, m_bands, parent);
+    m_progress->setWindowModality(Qt::WindowModal);
+    m_progress->setMinimumDuration(0);
+
+    connect(&m_watcher, SIGNAL(finished()), this, SLOT(bandFinished()));
+    connect(m_progress, SIGNAL(canceled()), this, SLOT(cancel()));
+}
+
+BandPrinter::~BandPrinter()
+{
+    m_watcher.waitForFinished();
+    delete m_progress;
+}
+
+bool BandPrinter::exec()
+{
+    if (m_image.isNull() || !m_painter.begin(m_printer))
+        return false;
+
+    m_painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    startBand(0);
+    m_loop.exec();
+
+    const bool printed = !m_canceled;
+    if (!printed) {
+        m_printer->abort();
+    }
+    m_painter.end();
+
+    // closing the dialog emits canceled()
+    disconnect(m_progress, 0, this, 0);
+    m_progress->close();
+
+    return printed;
+}
+
+void BandPrinter::startBand(int band)
+{
+    m_current = band;
+    m_watcher.setFuture(QtConcurrent::run(this, &BandPrinter::renderBand, band));
+}
+
+void BandPrinter::bandFinished()
+{
+    if (m_canceled)
+        return;
+
+    QImage band = m_watcher.result();
+    const int band_index = m_current;
+
+    // let the worker prepare the next band while this one goes to the spooler
+    if (band_index + 1 < m_bands) {
+        startBand(band_index + 1);
+    }
+
+    m_painter.drawImage(m_target.topLeft() + QPoint(0, band_index * BandHeight), band);
+    m_progress->setValue(band_index + 1);
+
+    if (band_index + 1 >= m_bands) {
+        m_loop.quit();
+    }
+}
+
+void BandPrinter::cancel()
+{
+    m_canceled = true;
+    m_loop.quit();
+}
+
+// Rows [band * BandHeight, ...) of the rotated image scaled to the target size
+QImage BandPrinter::renderBand(int band) const
+{
+    const int y0 = band * BandHeight;
+    const int y1 = qMin(y0 + BandHeight, m_target.height());
+
+    // source rows of the rotated image, with a margin covering the resampling
+    // filter, whose support is 3 source rows, stretched when shrinking
+    const int margin = qCeil(3 / qMin(1.0, m_scale)) + 1;
+    const int sy0 = qMax(0, qFloor(y0 / m_scale) - margin);
+    const int sy1 = qMin(m_rotatedSize.height(), qCeil(y1 / m_scale) + margin);
+    const QRect rotated(0, sy0, m_rotatedSize.width(), sy1 - sy0);
+
+    QImage chunk = m_image.copy(m_rotation.inverted().mapRect(rotated).intersected(m_image.rect()));
+    chunk = algorithms::applyLut(chunk, m_lut);
+    if (m_rotateAngle % 360 != 0) {
+        QTransform rotate;
+        rotate.rotate(m_rotateAngle);
+        chunk = chunk.transformed(rotate);
+    }
+
+    // every band uses the scale of the whole page, so the bands meet exactly
+    return algorithms::resampleRows(chunk, sy0, m_rotatedSize.height(), m_target.size(), y0, y1);
+}
+
+#endif // QT_NO_PRINTER
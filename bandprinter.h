@@ -0,0 +1,62 @@
+#ifndef BANDPRINTER_H
+#define BANDPRINTER_H
+
+#include <QObject>
+#include <QImage>
+#include <QTransform>
+#include <QFutureWatcher>
+#include <QEventLoop>
+#include <QPainter>
+#include <QVector>
+
+class QPrinter;
+class QProgressDialog;
+
+#ifndef QT_NO_PRINTER
+
+// Prints an image in horizontal bands. Each band is cut from the source,
+// rotated and scaled to printer resolution on a worker thread while the
+// previous band is sent to the printer, so at most two bands are in memory.
+// A tone lookup table, if any, is applied to each band as it is cut.
+class BandPrinter : public QObject
+{
+    Q_OBJECT
+
+public:
+    BandPrinter(QPrinter *printer, const QImage& image, int rotateAngle,
+                const QVector<quint8>& lut = QVector<quint8>(), QWidget *parent = 0);
+    ~BandPrinter();
+
+    // blocks until printing is done or canceled, keeping the event loop running
+    bool exec();
+
+    static const int BandHeight = 256;
+
+private slots:
+    void bandFinished();
+    void cancel();
+
+private:
+    QImage renderBand(int band) const;
+    void startBand(int band);
+
+    QPrinter *m_printer;
+    QImage m_image;
+    QVector<quint8> m_lut;
+    int m_rotateAngle;
+    QTransform m_rotation;
+    QSize m_rotatedSize;
+    QRect m_target;
+    double m_scale;
+    int m_bands;
+    int m_current;
+    bool m_canceled;
+    QPainter m_painter;
+    QFutureWatcher<QImage> m_watcher;
+    QProgressDialog *m_progress;
+    QEventLoop m_loop;
+};
+
+#endif // QT_NO_PRINTER
+
+#endif // BANDPRINTER_H
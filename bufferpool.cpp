@@ -0,0 +1,134 @@
+#include <QtWidgets>
+#include <cstring>
+#include "bufferpool.h"
+
+namespace algorithms
+{
+    // round requests up so slightly different sizes share buffers
+    static const size_t Granularity = 4096;
+
+    BufferPool::BufferPool() :
+        m_capacity(size_t(512) << 20)
+    {
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    BufferPool::~BufferPool() {
+        trim();
+    }
+
+    BufferPool& BufferPool::instance() {
+        static BufferPool pool;
+        return pool;
+    }
+
+    uchar* BufferPool::acquire(size_t bytes) {
+        bytes = (bytes + Granularity - 1) / Granularity * Granularity;
+
+        QMutexLocker locker(&m_mutex);
+
+        // best fit, but don't waste more than a quarter of a buffer
+        auto it = m_idle.lower_bound(bytes);
+        if (it != m_idle.end() && it->first <= bytes + bytes / 4) {
+            uchar *buffer = it->second;
+            m_stats.idleBytes -= it->first;
+            m_stats.reusedBytes += it->first;
+            m_stats.reuses++;
+            m_idle.erase(it);
+            return buffer;
+        }
+
+        uchar *buffer = static_cast<uchar*>(qMallocAligned(bytes, Alignment));
+        if (!buffer)
+            return 0;
+
+        m_sizes[buffer] = bytes;
+        m_stats.allocatedBytes += bytes;
+        m_stats.allocations++;
+        return buffer;
+    }
+
+    void BufferPool::release(uchar* buffer) {
+        if (!buffer)
+            return;
+
+        QMutexLocker locker(&m_mutex);
+        const size_t bytes = m_sizes[buffer];
+
+        // keep the most recent buffers, drop the largest idle ones when full
+        m_idle.insert(std::make_pair(bytes, buffer));
+        m_stats.idleBytes += bytes;
+        while (m_stats.idleBytes > m_capacity && !m_idle.empty()) {
+            auto largest = std::prev(m_idle.end());
+            m_stats.idleBytes -= largest->first;
+            m_sizes.erase(largest->second);
+            qFreeAligned(largest->second);
+            m_idle.erase(largest);
+        }
+    }
+
+    void BufferPool::setCapacity(size_t bytes) {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_capacity = bytes;
+        }
+        if (statistics().idleBytes > bytes) {
+            trim();
+        }
+    }
+
+    // free all idle buffers
+    void BufferPool::trim() {
+        QMutexLocker locker(&m_mutex);
+        for (auto& idle : m_idle) {
+            m_sizes.erase(idle.second);
+            qFreeAligned(idle.second);
+        }
+        m_idle.clear();
+        m_stats.idleBytes = 0;
+    }
+
+    BufferPool::Statistics BufferPool::statistics() const {
+        QMutexLocker locker(&m_mutex);
+        return m_stats;
+    }
+
+
+    static void releasePooledBuffer(void *buffer) {
+        BufferPool::instance().release(static_cast<uchar*>(buffer));
+    }
+
+    QImage pooledImage(const QSize& size, QImage::Format format) {
+        // rows aligned for SIMD loads
+        const int depth = QImage::toPixelFormat(format).bitsPerPixel();
+        const int align = static_cast<int>(BufferPool::Alignment);
+        const int bytesPerLine = ((size.width() * depth + 7) / 8 + align - 1) / align * align;
+
+        uchar *buffer = BufferPool::instance().acquire(size_t(bytesPerLine) * size.height());
+        if (!buffer)
+            return QImage(size, format);
+
+        return QImage(buffer, size.width(), size.height(), bytesPerLine, format,
+                      releasePooledBuffer, buffer);
+    }
+
+    QImage pooledCopy(const QImage& image, const QRect& rect) {
+        const QRect source = rect.intersected(image.rect());
+        if (source != rect || image.depth() < 8)
+            return image.copy(rect);
+
+        QImage res = pooledImage(rect.size(), image.format());
+        const int offset = rect.x() * image.depth() / 8;
+        const int bytes = rect.width() * image.depth() / 8;
+        for (int y = 0; y < rect.height(); y++) {
+            memcpy(res.scanLine(y), image.constScanLine(rect.y() + y) + offset, bytes);
+        }
+
+        // keep what QImage::copy() keeps, Indexed8 pixels mean nothing without the table
+        res.setColorTable(image.colorTable());
+        res.setDotsPerMeterX(image.dotsPerMeterX());
+        res.setDotsPerMeterY(image.dotsPerMeterY());
+        res.setOffset(image.offset());
+        return res;
+    }
+}
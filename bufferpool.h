@@ -0,0 +1,91 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QImage>
+#include <QMutex>
+#include <QRect>
+#include <map>
+#include <algorithm>
+
+namespace algorithms
+{
+    // Process wide pool of 64-byte aligned buffers for filter intermediates and tiles.
+    // Released buffers are kept (up to a capacity) and handed out again for requests
+    // of a similar size, so repeated filtering does not hit the heap for every image.
+    class BufferPool
+    {
+    public:
+        struct Statistics {
+            quint64 allocatedBytes;     // fresh allocations
+            quint64 reusedBytes;        // requests served from idle buffers
+            quint64 idleBytes;          // currently kept for reuse
+            quint64 allocations;
+            quint64 reuses;
+        };
+
+        static BufferPool& instance();
+
+        uchar* acquire(size_t bytes);
+        void release(uchar* buffer);
+
+        void setCapacity(size_t bytes);
+        void trim();
+        Statistics statistics() const;
+
+        static const size_t Alignment = 64;
+
+    private:
+        BufferPool();
+        ~BufferPool();
+        Q_DISABLE_COPY(BufferPool)
+
+        mutable QMutex m_mutex;
+        std::multimap<size_t, uchar*> m_idle;
+        std::map<uchar*, size_t> m_sizes;
+        size_t m_capacity;
+        Statistics m_stats;
+    };
+
+    // QImage over pooled memory; the buffer goes back to the pool with the last copy
+    QImage pooledImage(const QSize&, QImage::Format);
+    QImage pooledCopy(const QImage&, const QRect&);
+
+    // Uninitialized array of trivially copyable values in pooled memory, for
+    // per band scratch rows and tables; the buffer goes back to the pool with it
+    template<class T>
+    class PooledArray
+    {
+    public:
+        PooledArray() : m_data(0), m_size(0) {}
+        explicit PooledArray(size_t size) : m_data(0), m_size(0) { resize(size); }
+        ~PooledArray() { BufferPool::instance().release(reinterpret_cast<uchar*>(m_data)); }
+
+        // contents are not kept
+        void resize(size_t size) {
+            BufferPool::instance().release(reinterpret_cast<uchar*>(m_data));
+            m_data = 0;
+            if (size) {
+                m_data = reinterpret_cast<T*>(BufferPool::instance().acquire(size * sizeof(T)));
+                Q_CHECK_PTR(m_data);
+            }
+            m_size = size;
+        }
+
+        void fill(const T& value) { std::fill(m_data, m_data + m_size, value); }
+
+        size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+        T* data() { return m_data; }
+        const T* data() const { return m_data; }
+        T& operator[](size_t i) { return m_data[i]; }
+        const T& operator[](size_t i) const { return m_data[i]; }
+
+    private:
+        Q_DISABLE_COPY(PooledArray)
+
+        T *m_data;
+        size_t m_size;
+    };
+}
+
+#endif // BUFFERPOOL_H
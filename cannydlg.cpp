@@ -0,0 +1,64 @@
+#include "cannydlg.h"
+#include "ui_cannydlg.h"
+
+CannyDlg::CannyDlg(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::CannyDlg)
+{
+    ui->setupUi(this);
+    this->setWindowFlags(this->windowFlags() & ~Qt::WindowContextHelpButtonHint);
+
+    connect(ui->sigmaSlider, SIGNAL(valueChanged(int)), this, SLOT(onSliderChanged()));
+    connect(ui->tminSlider, SIGNAL(valueChanged(int)), this, SLOT(onSliderChanged()));
+    connect(ui->tmaxSlider, SIGNAL(valueChanged(int)), this, SLOT(onSliderChanged()));
+    // combo items are in the order of algorithms::Smoothing
+    connect(ui->smoothingCombo, SIGNAL(currentIndexChanged(int)), this, SIGNAL(smoothingChanged(int)));
+
+    onSliderChanged();
+}
+
+CannyDlg::~CannyDlg()
+{
+    delete ui;
+}
+
+// sigma slider works in tenths
+double CannyDlg::sigma() const
+{
+    return ui->sigmaSlider->value() / 10.0;
+}
+
+double CannyDlg::tmin() const
+{
+    return ui->tminSlider->value();
+}
+
+double CannyDlg::tmax() const
+{
+    return ui->tmaxSlider->value();
+}
+
+algorithms::Smoothing CannyDlg::smoothing() const
+{
+    return static_cast<algorithms::Smoothing>(ui->smoothingCombo->currentIndex());
+}
+
+void CannyDlg::onSliderChanged()
+{
+    // keep the low threshold below the high one
+    if (ui->tminSlider->value() > ui->tmaxSlider->value()) {
+        QObject* obj = sender();
+        if (obj == ui->tminSlider) {
+            ui->tmaxSlider->setValue(ui->tminSlider->value());
+        } else {
+            ui->tminSlider->setValue(ui->tmaxSlider->value());
+        }
+        return;
+    }
+
+    ui->sigmaValue->setText(QString::number(sigma(), 'f', 1));
+    ui->tminValue->setText(QString::number(tmin()));
+    ui->tmaxValue->setText(QString::number(tmax()));
+
+    emit parametersChanged(sigma(), tmin(), tmax());
+}
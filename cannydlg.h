@@ -0,0 +1,35 @@
+#ifndef CANNYDLG_H
+#define CANNYDLG_H
+
+#include <QDialog>
+#include "denoise.h"
+
+namespace Ui {
+class CannyDlg;
+}
+
+class CannyDlg : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit CannyDlg(QWidget *parent = 0);
+    ~CannyDlg();
+
+    double sigma() const;
+    double tmin() const;
+    double tmax() const;
+    algorithms::Smoothing smoothing() const;
+
+signals:
+    void parametersChanged(double sigma, double tmin, double tmax);
+    void smoothingChanged(int smoothing);
+
+private slots:
+    void onSliderChanged();
+
+private:
+    Ui::CannyDlg *ui;
+};
+
+#endif // CANNYDLG_H
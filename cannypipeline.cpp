@@ -0,0 +1,83 @@
+#include <QtWidgets>
+#include "cannypipeline.h"
+#include "algorithms.h"
+
+namespace algorithms
+{
+    CannyPipeline::CannyPipeline(const QImage& grayscale, double sigma, double tmin, double tmax,
+                                 Smoothing smoothing) :
+        m_input(grayscale), m_sigma(sigma), m_smoothing(smoothing), m_tmin(tmin), m_tmax(tmax),
+        m_blurValid(false), m_gradientsValid(false)
+    {
+    }
+
+    void CannyPipeline::setSigma(double sigma) {
+        if (sigma == m_sigma)
+            return;
+
+        m_sigma = sigma;
+        m_blurValid = false;
+        m_gradientsValid = false;
+    }
+
+    void CannyPipeline::setSmoothing(Smoothing smoothing) {
+        if (smoothing == m_smoothing)
+            return;
+
+        m_smoothing = smoothing;
+        m_blurValid = false;
+        m_gradientsValid = false;
+    }
+
+    void CannyPipeline::setThresholds(double tmin, double tmax) {
+        // hysteresis is computed on demand, nothing cached depends on thresholds
+        m_tmin = tmin;
+        m_tmax = tmax;
+    }
+
+    void CannyPipeline::updateBlur() {
+        if (m_blurValid)
+            return;
+
+        m_blurred = smooth(m_input, m_smoothing, m_sigma);
+        m_blurValid = true;
+    }
+
+    void CannyPipeline::updateGradients() {
+        if (m_gradientsValid)
+            return;
+
+        updateBlur();
+        m_gx = convolution(sobelx, m_blurred);
+        m_gy = convolution(sobely, m_blurred);
+
+        m_nms = pooledImage(m_input.size(), m_input.format());
+        magnitude(m_nms, m_gx, m_gy);
+        nonMaximumSuppression(m_nms, m_gx, m_gy);
+        m_gradientsValid = true;
+    }
+
+    const QImage& CannyPipeline::blurred() {
+        updateBlur();
+        return m_blurred;
+    }
+
+    const QImage& CannyPipeline::gradientX() {
+        updateGradients();
+        return m_gx;
+    }
+
+    const QImage& CannyPipeline::gradientY() {
+        updateGradients();
+        return m_gy;
+    }
+
+    const QImage& CannyPipeline::suppressed() {
+        updateGradients();
+        return m_nms;
+    }
+
+    QImage CannyPipeline::result() {
+        return hysteresis(suppressed(), m_tmin, m_tmax);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef CANNYPIPELINE_H
+#define CANNYPIPELINE_H
+
+#include <QImage>
+#include "denoise.h"
+
+namespace algorithms
+{
+    // Canny edge detector that keeps its intermediate stages.
+    // Changing sigma or smoothing recomputes blur, gradients and suppression; changing
+    // the thresholds only reruns hysteresis.
+    class CannyPipeline
+    {
+    public:
+        CannyPipeline(const QImage& grayscale, double sigma, double tmin, double tmax,
+                      Smoothing smoothing = Smoothing::Gaussian);
+
+        void setSigma(double sigma);
+        void setSmoothing(Smoothing smoothing);
+        void setThresholds(double tmin, double tmax);
+
+        double sigma() const { return m_sigma; }
+        Smoothing smoothing() const { return m_smoothing; }
+        double tmin() const { return m_tmin; }
+        double tmax() const { return m_tmax; }
+
+        const QImage& blurred();
+        const QImage& gradientX();
+        const QImage& gradientY();
+        const QImage& suppressed();
+
+        QImage result();
+
+        // extra pixels around a tile of the preview so edges entering it are traced
+        static const int HysteresisHalo = 16;
+
+    private:
+        void updateBlur();
+        void updateGradients();
+
+        QImage m_input;
+        QImage m_blurred;
+        QImage m_gx;
+        QImage m_gy;
+        QImage m_nms;
+        double m_sigma;
+        Smoothing m_smoothing;
+        double m_tmin;
+        double m_tmax;
+        bool m_blurValid;
+        bool m_gradientsValid;
+    };
+}
+
+#endif // CANNYPIPELINE_H
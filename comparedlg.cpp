@@ -0,0 +1,93 @@
+#include "comparedlg.h"
+#include "ui_comparedlg.h"
+#include "imgviewer.h"
+
+CompareDlg::CompareDlg(const QImage& original, const QImage& filtered, const QString& name, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::CompareDlg),
+    m_filtered(filtered),
+    m_syncing(false)
+{
+    ui->setupUi(this);
+    this->setWindowFlags(this->windowFlags() & ~Qt::WindowContextHelpButtonHint);
+
+    m_views << ui->leftView << ui->rightView;
+    ui->leftView->setImage(original, name);
+    ui->rightView->setImage(filtered, name);
+
+    foreach (ImgViewer *view, m_views) {
+        connect(view, SIGNAL(viewChanged()), this, SLOT(syncViews()));
+    }
+    connect(ui->modeCombo, SIGNAL(currentIndexChanged(int)), this, SLOT(onModeChanged(int)));
+    connect(ui->mixSlider, SIGNAL(valueChanged(int)), this, SLOT(onMixChanged(int)));
+
+    onModeChanged(ui->modeCombo->currentIndex());
+}
+
+CompareDlg::~CompareDlg()
+{
+    delete ui;
+}
+
+void CompareDlg::showEvent(QShowEvent *event)
+{
+    QDialog::showEvent(event);
+
+    // start with the whole image in view, but keep zoom and pan available
+    ui->leftView->fitWindow();
+    foreach (ImgViewer *view, m_views) {
+        view->setDragMode(QGraphicsView::ScrollHandDrag);
+    }
+}
+
+void CompareDlg::syncViews()
+{
+    ImgViewer *source = qobject_cast<ImgViewer*>(sender());
+    if (source)
+        syncFrom(source);
+}
+
+// mirror zoom, rotation and pan of the view that changed to the others
+void CompareDlg::syncFrom(ImgViewer *source)
+{
+    if (m_syncing)
+        return;
+
+    m_syncing = true;
+    QPointF center = source->mapToScene(source->viewport()->rect().center());
+    foreach (ImgViewer *view, m_views) {
+        if (view == source || !view->isVisible())
+            continue;
+        view->setTransform(source->transform());
+        view->centerOn(center);
+    }
+    m_syncing = false;
+}
+
+void CompareDlg::onModeChanged(int mode)
+{
+    // the tiles of the filtered image are shared with the right view through the tile cache
+    ui->rightView->setVisible(mode == SideBySide);
+    ui->mixSlider->setEnabled(mode != SideBySide);
+
+    if (mode == SideBySide) {
+        ui->leftView->setOverlayImage(QImage());
+        syncFrom(ui->leftView);
+        return;
+    }
+
+    ui->leftView->setOverlayImage(m_filtered);
+    onMixChanged(ui->mixSlider->value());
+}
+
+void CompareDlg::onMixChanged(int value)
+{
+    const qreal mix = value / 100.0;
+    if (ui->modeCombo->currentIndex() == Swipe) {
+        ui->leftView->setOverlayOpacity(1);
+        ui->leftView->setOverlaySwipe(mix);
+    } else if (ui->modeCombo->currentIndex() == Blend) {
+        ui->leftView->setOverlayOpacity(mix);
+        ui->leftView->setOverlaySwipe(1);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef COMPAREDLG_H
+#define COMPAREDLG_H
+
+#include <QDialog>
+#include <QList>
+
+namespace Ui {
+class CompareDlg;
+}
+
+class ImgViewer;
+
+// Original and filtered image side by side with synchronized zoom and pan,
+// or overlaid in one view with a swipe or blend slider
+class CompareDlg : public QDialog
+{
+    Q_OBJECT
+
+public:
+    CompareDlg(const QImage& original, const QImage& filtered, const QString& name, QWidget *parent = 0);
+    ~CompareDlg();
+
+protected:
+    virtual void showEvent(QShowEvent *event);
+
+private slots:
+    void syncViews();
+    void onModeChanged(int mode);
+    void onMixChanged(int value);
+
+private:
+    void syncFrom(ImgViewer *source);
+
+    enum Mode { SideBySide, Swipe, Blend };
+
+    Ui::CompareDlg *ui;
+    QList<ImgViewer*> m_views;
+    QImage m_filtered;
+    bool m_syncing;
+};
+
+#endif // COMPAREDLG_H
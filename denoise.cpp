@@ -0,0 +1,286 @@
+#include <QtWidgets>
+#include <cmath>
+#include <cstring>
+#include "denoise.h"
+#include "algorithms.h"
+#include "parallel.h"
+#include "bufferpool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace algorithms
+{
+    // 256 fine bins and 16 coarse bins of 16 levels each, the coarse level
+    // lets the median search skip most of the fine bins
+    struct MedianBins {
+        quint16 fine[256];
+        quint16 coarse[16];
+    };
+
+    static inline void addBins(MedianBins& dst, const MedianBins& src) {
+#ifdef __SSE2__
+        __m128i *d = reinterpret_cast<__m128i*>(&dst);
+        const __m128i *s = reinterpret_cast<const __m128i*>(&src);
+        for (size_t i = 0; i < sizeof(MedianBins) / sizeof(__m128i); i++) {
+            _mm_storeu_si128(d + i, _mm_add_epi16(_mm_loadu_si128(d + i), _mm_loadu_si128(s + i)));
+        }
+#else
+        for (int i = 0; i < 256; i++) {
+            dst.fine[i] += src.fine[i];
+        }
+        for (int i = 0; i < 16; i++) {
+            dst.coarse[i] += src.coarse[i];
+        }
+#endif
+    }
+
+    static inline void subBins(MedianBins& dst, const MedianBins& src) {
+#ifdef __SSE2__
+        __m128i *d = reinterpret_cast<__m128i*>(&dst);
+        const __m128i *s = reinterpret_cast<const __m128i*>(&src);
+        for (size_t i = 0; i < sizeof(MedianBins) / sizeof(__m128i); i++) {
+            _mm_storeu_si128(d + i, _mm_sub_epi16(_mm_loadu_si128(d + i), _mm_loadu_si128(s + i)));
+        }
+#else
+        for (int i = 0; i < 256; i++) {
+            dst.fine[i] -= src.fine[i];
+        }
+        for (int i = 0; i < 16; i++) {
+            dst.coarse[i] -= src.coarse[i];
+        }
+#endif
+    }
+
+    static inline quint8 binsMedian(const MedianBins& h, int rank) {
+        int sum = 0;
+        int bucket = 0;
+        while (sum + h.coarse[bucket] <= rank) {
+            sum += h.coarse[bucket++];
+        }
+        int level = bucket * 16;
+        while (sum + h.fine[level] <= rank) {
+            sum += h.fine[level++];
+        }
+        return level;
+    }
+
+    QImage medianFilter(const QImage& input, int radius) {
+        const QImage image = toByteChannels(input);
+
+        const int r = qBound(0, radius, 127);
+        const int width = image.width();
+        const int height = image.height();
+        const int channels = image.depth() / 8;
+        const int alpha = channels == 4 ? alphaByteIndex() : -1;
+        const int rank = (2 * r + 1) * (2 * r + 1) / 2;
+        // column stripes keep the histograms of a stripe in cache
+        const int stripe = 128;
+
+        QImage res = pooledImage(image.size(), image.format());
+        auto column = [width](int x) { return qBound(0, x, width - 1); };
+        auto row = [height](int y) { return qBound(0, y, height - 1); };
+
+        // every row band fills its column histograms once, then slides them down
+        const ImageRows resRows(res);
+        parallelBands(height, [&](int begin, int end) {
+            PooledArray<MedianBins> columns(stripe + 2 * r);
+            MedianBins kernel;
+
+            for (int c = 0; c < channels; c++) {
+                if (c == alpha) {
+                    for (int y = begin; y < end; y++) {
+                        const quint8 *src = image.constScanLine(y);
+                        quint8 *dst = resRows[y];
+                        for (int x = 0; x < width; x++) {
+                            dst[x * channels + c] = src[x * channels + c];
+                        }
+                    }
+                    continue;
+                }
+
+                for (int x0 = 0; x0 < width; x0 += stripe) {
+                    const int x1 = qMin(x0 + stripe, width);
+                    const int count = x1 - x0 + 2 * r;
+                    memset(columns.data(), 0, count * sizeof(MedianBins));
+
+                    for (int y = begin - r; y <= begin + r; y++) {
+                        const quint8 *line = image.constScanLine(row(y));
+                        for (int i = 0; i < count; i++) {
+                            const quint8 v = line[column(x0 - r + i) * channels + c];
+                            columns[i].fine[v]++;
+                            columns[i].coarse[v >> 4]++;
+                        }
+                    }
+
+                    for (int y = begin; y < end; y++) {
+                        if (y > begin) {
+                            const quint8 *out = image.constScanLine(row(y - r - 1));
+                            const quint8 *in = image.constScanLine(row(y + r));
+                            for (int i = 0; i < count; i++) {
+                                const int offset = column(x0 - r + i) * channels + c;
+                                columns[i].fine[out[offset]]--;
+                                columns[i].coarse[out[offset] >> 4]--;
+                                columns[i].fine[in[offset]]++;
+                                columns[i].coarse[in[offset] >> 4]++;
+                            }
+                        }
+
+                        memset(&kernel, 0, sizeof(MedianBins));
+                        for (int i = 0; i <= 2 * r; i++) {
+                            addBins(kernel, columns[i]);
+                        }
+
+                        quint8 *dst = resRows[y];
+                        for (int x = x0; x < x1; x++) {
+                            if (x > x0) {
+                                addBins(kernel, columns[x - x0 + 2 * r]);
+                                subBins(kernel, columns[x - x0 - 1]);
+                            }
+                            dst[x * channels + c] = binsMedian(kernel, rank);
+                        }
+                    }
+                }
+            }
+        }, qMax(16, 4 * r));
+
+        return res;
+    }
+
+
+    // value sum and weight of the pixels splatted into a grid cell
+    struct GridCell {
+        float value;
+        float weight;
+    };
+
+    // [1 4 6 4 1] / 16 along one axis of the grid, from src into dst
+    static void blurGrid(const PooledArray<GridCell>& src, PooledArray<GridCell>& dst,
+                         int count, size_t stride, size_t cells) {
+        static const float taps[5] = { 1 / 16.f, 4 / 16.f, 6 / 16.f, 4 / 16.f, 1 / 16.f };
+
+        for (size_t i = 0; i < cells; i++) {
+            const int pos = int(i / stride % count);
+            GridCell sum = { 0, 0 };
+            for (int t = -2; t <= 2; t++) {
+                if (pos + t < 0 || pos + t >= count)
+                    continue;
+                const GridCell& cell = src[i + t * stride];
+                sum.value += taps[t + 2] * cell.value;
+                sum.weight += taps[t + 2] * cell.weight;
+            }
+            dst[i] = sum;
+        }
+    }
+
+    QImage bilateralFilter(const QImage& input, double sigmaSpatial, double sigmaRange) {
+        const QImage image = toByteChannels(input);
+
+        const double ss = qMax(1.0, sigmaSpatial);
+        const double sr = qMax(1.0, sigmaRange);
+        const int width = image.width();
+        const int height = image.height();
+        const int channels = image.depth() / 8;
+        const int alpha = channels == 4 ? alphaByteIndex() : -1;
+
+        // two cells of padding on every side for the blur, one more for interpolation
+        const int pad = 2;
+        const int gw = qRound((width - 1) / ss) + 2 * pad + 2;
+        const int gd = qRound(255 / sr) + 2 * pad + 2;
+
+        QImage res = pooledImage(image.size(), image.format());
+
+        // Every row band builds the part of the grid it slices from, plus the
+        // rows the blur reaches into, so bands are independent and the grid
+        // never exists for the whole image at once.
+        const ImageRows resRows(res);
+        parallelBands(height, [&](int begin, int end) {
+            const int first = int(std::floor(begin / ss)) - pad;
+            const int last = int(std::ceil((end - 1) / ss)) + 1 + pad;
+            const int gh = last - first + 1;
+            const size_t cells = size_t(gh) * gw * gd;
+            PooledArray<GridCell> grid(cells), temp(cells);
+
+            for (int c = 0; c < channels; c++) {
+                if (c == alpha) {
+                    for (int y = begin; y < end; y++) {
+                        const quint8 *src = image.constScanLine(y);
+                        quint8 *dst = resRows[y];
+                        for (int x = 0; x < width; x++) {
+                            dst[x * channels + c] = src[x * channels + c];
+                        }
+                    }
+                    continue;
+                }
+
+                grid.fill(GridCell { 0, 0 });
+                const int top = qMax(0, int(std::ceil((first - 0.5) * ss)));
+                const int bottom = qMin(height - 1, int(std::floor((last + 0.5) * ss)));
+                for (int y = top; y <= bottom; y++) {
+                    const int gy = qRound(y / ss) - first;
+                    if (gy < 0 || gy >= gh)
+                        continue;
+                    const quint8 *line = image.constScanLine(y);
+                    for (int x = 0; x < width; x++) {
+                        const quint8 v = line[x * channels + c];
+                        GridCell& cell = grid[(size_t(gy) * gw + qRound(x / ss) + pad) * gd + qRound(v / sr) + pad];
+                        cell.value += v;
+                        cell.weight += 1;
+                    }
+                }
+
+                blurGrid(grid, temp, gd, 1, cells);
+                blurGrid(temp, grid, gw, gd, cells);
+                blurGrid(grid, temp, gh, size_t(gw) * gd, cells);
+
+                // trilinear slice
+                for (int y = begin; y < end; y++) {
+                    const double fy = y / ss - first;
+                    const int y0 = int(fy);
+                    const float wy = fy - y0;
+                    const quint8 *src = image.constScanLine(y);
+                    quint8 *dst = resRows[y];
+
+                    for (int x = 0; x < width; x++) {
+                        const quint8 v = src[x * channels + c];
+                        const double fx = x / ss + pad;
+                        const double fz = v / sr + pad;
+                        const int x0 = int(fx);
+                        const int z0 = int(fz);
+                        const float wx = fx - x0;
+                        const float wz = fz - z0;
+
+                        GridCell sum = { 0, 0 };
+                        for (int j = 0; j < 2; j++) {
+                            for (int i = 0; i < 2; i++) {
+                                const GridCell *cell = &temp[(size_t(y0 + j) * gw + x0 + i) * gd + z0];
+                                const float w = (j ? wy : 1 - wy) * (i ? wx : 1 - wx);
+                                sum.value += w * ((1 - wz) * cell[0].value + wz * cell[1].value);
+                                sum.weight += w * ((1 - wz) * cell[0].weight + wz * cell[1].weight);
+                            }
+                        }
+
+                        dst[x * channels + c] = sum.weight > 0
+                                ? qBound(0, qRound(sum.value / sum.weight), 0xFF) : v;
+                    }
+                }
+            }
+        }, qMax(16, qRound(8 * ss)));
+
+        return res;
+    }
+
+
+    QImage smooth(const QImage& input, Smoothing smoothing, double sigma) {
+        switch (smoothing) {
+        case Smoothing::Median:
+            return medianFilter(input, qMax(1, qRound(2 * sigma)));
+        case Smoothing::Bilateral:
+            return bilateralFilter(input, 2 * sigma, 30);
+        case Smoothing::Gaussian:
+            break;
+        }
+        return convolution(getGaussianKernel(sigma), input);
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include <QImage>
+
+namespace algorithms
+{
+    // smoothing stage in front of edge detection
+    enum class Smoothing { Gaussian, Median, Bilateral };
+
+    // Median of the (2r + 1)^2 neighbourhood, per channel, constant time per
+    // pixel whatever the radius (Perreault-Hebert column histograms).
+    // Radius is limited to 127.
+    QImage medianFilter(const QImage&, int);
+
+    // Edge preserving blur on a bilateral grid: sigma spatial in pixels,
+    // sigma range in grey levels; cost does not grow with sigma spatial.
+    QImage bilateralFilter(const QImage&, double, double);
+
+    // Gaussian, median or bilateral smoothing of comparable strength for sigma
+    QImage smooth(const QImage&, Smoothing, double);
+}
+
+#endif // DENOISE_H
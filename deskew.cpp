@@ -0,0 +1,143 @@
+#include <QtWidgets>
+#include <cmath>
+#include <vector>
+#include "deskew.h"
+#include "algorithms.h"
+#include "resampler.h"
+#include "parallel.h"
+
+namespace algorithms
+{
+    // longest side of the levels used for the coarse and the refining pass
+    static const int CoarseSize = 1024;
+    static const int FineSize = 2048;
+    // 5x5 gaussian and 3x3 sobel reach 3 pixels into the image
+    static const int BorderMargin = 4;
+    // parts of a vote split between two rho bins
+    static const quint32 VoteSplit = 16;
+
+    static QImage pageLevel(const QImage& image, int longest) {
+        const int side = qMax(image.width(), image.height());
+        if (side <= longest)
+            return image;
+        const double scale = double(longest) / side;
+        return resample(image, QSize(qMax(1, qRound(image.width() * scale)),
+                                     qMax(1, qRound(image.height() * scale))));
+    }
+
+    static std::vector<QPoint> edgePoints(const QImage& image) {
+        QImage gray = image.format() == QImage::Format_Grayscale8
+                ? image : image.convertToFormat(QImage::Format_Grayscale8);
+        QImage edges = canny(gray, 1, 40, 120);
+
+        // the blur and the gradients read zeros past the image, so canny finds
+        // edges all along the border; they are axis aligned and as long as the
+        // page, and would outvote the text lines of a skewed page
+        const int margin = BorderMargin;
+        std::vector<QPoint> points;
+        QMutex mutex;
+        parallelBands(qMax(0, edges.height() - 2 * margin), [&](int begin, int end) {
+            std::vector<QPoint> band;
+            for (int y = begin + margin; y < end + margin; y++) {
+                const quint8 *line = edges.constScanLine(y);
+                for (int x = margin; x < edges.width() - margin; x++) {
+                    if (line[x])
+                        band.push_back(QPoint(x, y));
+                }
+            }
+            QMutexLocker locker(&mutex);
+            points.insert(points.end(), band.begin(), band.end());
+        });
+        return points;
+    }
+
+    // Vote every edge point for the lines through it at each candidate angle,
+    // then pick the angle whose votes are most concentrated (largest sum of
+    // squares), which is where text baselines and x-heights line up.
+    // A vote is split between the two nearest rho bins, so the score follows
+    // the angle smoothly instead of in steps of a whole pixel of drift.
+    static double houghAngle(const std::vector<QPoint>& points, const QSize& size,
+                             double from, double to, double step) {
+        const int angles = qMax(1, qRound((to - from) / step) + 1);
+        const int offset = size.width() + size.height();
+        const int rhos = 2 * offset + 2;
+
+        // rho = y cos(a) - x sin(a), the distance along the line normal
+        std::vector<float> cosines(angles), sines(angles);
+        for (int a = 0; a < angles; a++) {
+            const double angle = qDegreesToRadians(from + a * step);
+            cosines[a] = std::cos(angle);
+            sines[a] = std::sin(angle);
+        }
+
+        // one vote array per thread, merged at the end
+        std::vector<quint32> votes(size_t(angles) * rhos, 0);
+        QMutex mutex;
+        const int count = int(points.size());
+        parallelBands(count, [&](int begin, int end) {
+            std::vector<quint32> local(size_t(angles) * rhos, 0);
+            for (int i = begin; i < end; i++) {
+                const float x = points[i].x();
+                const float y = points[i].y();
+                for (int a = 0; a < angles; a++) {
+                    const float r = y * cosines[a] - x * sines[a] + offset;
+                    const int rho = int(r);
+                    const quint32 upper = quint32((r - rho) * VoteSplit + 0.5f);
+                    local[size_t(a) * rhos + rho] += VoteSplit - upper;
+                    local[size_t(a) * rhos + rho + 1] += upper;
+                }
+            }
+            QMutexLocker locker(&mutex);
+            for (size_t i = 0; i < local.size(); i++) {
+                votes[i] += local[i];
+            }
+        }, qMax(1024, count / QThread::idealThreadCount()));
+
+        int best = angles / 2;
+        double bestScore = -1;
+        for (int a = 0; a < angles; a++) {
+            double score = 0;
+            const quint32 *row = &votes[size_t(a) * rhos];
+            for (int r = 0; r < rhos; r++) {
+                score += double(row[r]) * row[r];
+            }
+            if (score > bestScore) {
+                bestScore = score;
+                best = a;
+            }
+        }
+        return from + best * step;
+    }
+
+    double detectSkew(const QImage& image, double maxAngle) {
+        if (image.isNull())
+            return 0;
+
+        QImage fine = pageLevel(image, FineSize);
+        QImage coarse = pageLevel(fine, CoarseSize);
+
+        // The votes of a text line stay in one rho bin until its ends drift a
+        // pixel apart, so the score peak is about 1 / length radians wide for
+        // the lines of the page, not for the page: a 300 px line at the coarse
+        // level gives 0.19 degrees. A 0.2 degree step lands on that peak and is
+        // at most a step off; the refining pass searches one coarse step either
+        // side of the pick in 0.02 degree steps, so it covers both.
+        std::vector<QPoint> points = edgePoints(coarse);
+        if (points.empty())
+            return 0;
+        const double coarseStep = 0.2;
+        const double fineStep = 0.02;
+        double angle = houghAngle(points, coarse.size(), -maxAngle, maxAngle, coarseStep);
+
+        if (fine.size() != coarse.size())
+            points = edgePoints(fine);
+        return houghAngle(points, fine.size(), angle - coarseStep, angle + coarseStep, fineStep);
+    }
+
+    QImage deskew(const QImage& image, double maxAngle) {
+        const double angle = detectSkew(image, maxAngle);
+        if (qAbs(angle) < 0.01)
+            return image;
+        return rotate(image, -angle);
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef DESKEW_H
+#define DESKEW_H
+
+#include <QImage>
+
+namespace algorithms
+{
+    // Angle in degrees of the dominant text lines, positive when lines go down
+    // to the right, searched within +-maxAngle. Hough transform over Canny
+    // edges, coarse on a small level of the page and refined on a larger one.
+    double detectSkew(const QImage&, double = 10);
+
+    // page rotated so the dominant lines are horizontal
+    QImage deskew(const QImage&, double = 10);
+}
+
+#endif // DESKEW_H
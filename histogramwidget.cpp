@@ -0,0 +1,70 @@
+#include "histogramwidget.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <QtMath>
+
+HistogramWidget::HistogramWidget(QWidget *parent) :
+    QWidget(parent), m_bins(256, 0)
+{
+}
+
+void HistogramWidget::setHistogram(const algorithms::Histogram& histogram)
+{
+    for (int i = 0; i < 256; i++) {
+        m_bins[i] = histogram.luma[i];
+    }
+    update();
+}
+
+void HistogramWidget::setLut(const algorithms::Lut& lut)
+{
+    m_lut = lut;
+    update();
+}
+
+QSize HistogramWidget::sizeHint() const
+{
+    return QSize(256, 120);
+}
+
+void HistogramWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(38, 38, 38));
+
+    // the lookup table moves counts between bins, the image is not touched
+    QVector<quint32> bins(256, 0);
+    for (int i = 0; i < 256; i++) {
+        bins[m_lut.isEmpty() ? i : m_lut[i]] += m_bins[i];
+    }
+    quint32 peak = 1;
+    for (int i = 0; i < 256; i++) {
+        peak = qMax(peak, bins[i]);
+    }
+
+    // square root scale keeps sparse tones visible next to the paper peak
+    const qreal w = width() / 256.0;
+    const qreal h = height();
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(0xcc, 0xcc, 0xcc));
+    for (int i = 0; i < 256; i++) {
+        const qreal bar = h * qSqrt(qreal(bins[i]) / peak);
+        painter.drawRect(QRectF(i * w, h - bar, w, bar));
+    }
+
+    if (!m_lut.isEmpty()) {
+        QPainterPath curve;
+        for (int i = 0; i < 256; i++) {
+            const QPointF point((i + 0.5) * w, h - 1 - m_lut[i] * (h - 2) / 255);
+            if (i == 0)
+                curve.moveTo(point);
+            else
+                curve.lineTo(point);
+        }
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setPen(QPen(QColor(0xff, 0x99, 0x33), 1.5));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawPath(curve);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef HISTOGRAMWIDGET_H
+#define HISTOGRAMWIDGET_H
+
+#include <QWidget>
+#include "tone.h"
+
+// Luminance histogram as it looks after a tone lookup table, with the table
+// drawn over it
+class HistogramWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit HistogramWidget(QWidget *parent = 0);
+
+    void setHistogram(const algorithms::Histogram& histogram);
+    void setLut(const algorithms::Lut& lut);
+
+    QSize sizeHint() const;
+
+protected:
+    virtual void paintEvent(QPaintEvent *event);
+
+private:
+    QVector<quint32> m_bins;
+    algorithms::Lut m_lut;
+};
+
+#endif // HISTOGRAMWIDGET_H
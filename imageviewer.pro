@@ -6,6 +6,7 @@
 
 QT       += core gui
 QT       += printsupport
+QT       += concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -17,16 +18,64 @@ SOURCES += main.cpp\
         mainwindow.cpp \
     imgviewer.cpp \
     aboutdlg.cpp \
-    algorithms.cpp
+    algorithms.cpp \
+    roifilter.cpp \
+    cannypipeline.cpp \
+    cannydlg.cpp \
+    morphologydlg.cpp \
+    integralimage.cpp \
+    morphology.cpp \
+    denoise.cpp \
+    deskew.cpp \
+    pyramid.cpp \
+    pagestore.cpp \
+    tone.cpp \
+    bufferpool.cpp \
+    bandprinter.cpp \
+    resampler.cpp \
+    tiledimageitem.cpp \
+    comparedlg.cpp \
+    histogramwidget.cpp \
+    tonedlg.cpp
 
 HEADERS  += mainwindow.h \
     imgviewer.h \
     aboutdlg.h \
     algorithms.h \
-    kernels.h
+    kernels.h \
+    roifilter.h \
+    cannypipeline.h \
+    cannydlg.h \
+    morphologydlg.h \
+    integralimage.h \
+    morphology.h \
+    denoise.h \
+    deskew.h \
+    pyramid.h \
+    pagestore.h \
+    tone.h \
+    parallel.h \
+    bufferpool.h \
+    bandprinter.h \
+    resampler.h \
+    tiledimageitem.h \
+    comparedlg.h \
+    histogramwidget.h \
+    tonedlg.h
 
 FORMS    += mainwindow.ui \
-    aboutdlg.ui
+    aboutdlg.ui \
+    cannydlg.ui \
+    morphologydlg.ui \
+    comparedlg.ui \
+    tonedlg.ui
 
 RESOURCES += \
     imageViewer.qrc
+
+# "make check" builds and runs the algorithm tests of tests/tests.pro in
+# the tests directory of this build; qiv.pro builds both as subprojects
+check.depends = first
+check.commands = $$sprintf($$QMAKE_MKDIR_CMD, tests) && cd tests \
+    && $(QMAKE) $$shell_quote($$shell_path($$PWD/tests/tests.pro)) && $(MAKE) check
+QMAKE_EXTRA_TARGETS += check
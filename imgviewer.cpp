@@ -6,19 +6,34 @@
 #include <QWheelEvent>
 #include <QtMath>
 #include <QMatrix>
+#include <QtConcurrent>
 
-#include <random>
 #include "algorithms.h"
 #include "kernels.h"
+#include "cannypipeline.h"
+#include "integralimage.h"
+#include "bandprinter.h"
+#include "deskew.h"
+#include "pyramid.h"
+#include "resampler.h"
 #include <iostream>
+#include <random>
 
 ImgViewer::ImgViewer(QWidget *parent) :
-    QGraphicsView(parent), m_rotateAngle(0), m_IsFitWindow(false), m_IsViewInitialized(false)
+    QGraphicsView(parent), m_imageItem(0), m_overlayItem(0), m_rotateAngle(0), m_IsFitWindow(false), m_IsViewInitialized(false),
+    m_IsRoiMode(false)
 {
     m_scene = new QGraphicsScene(this);
     this->setScene(m_scene);
     this->setBackgroundBrush(QBrush(QColor(38,38,38,255),Qt::SolidPattern));
     this->setDragMode(NoDrag);
+
+    connect(&m_roiWatcher, SIGNAL(finished()), this, SLOT(roiTileFinished()));
+}
+
+ImgViewer::~ImgViewer()
+{
+    cancelRoiJob();
 }
 
 void ImgViewer::resetView()
@@ -27,10 +42,18 @@ void ImgViewer::resetView()
         return;
     }
 
+    cancelRoiJob();
+    m_canny.reset();
+    m_cannyInput = QImage();
     m_scene->clear();
+    m_imageItem = 0;
+    m_overlayItem = 0;
     m_image = QImage();
+    m_original = QImage();
+    m_overlay = QImage();
     m_fileName.clear();
     m_rotateAngle = 0;
+    m_toneLut.clear();
     this->setDragMode(NoDrag);
     this->resetTransform();
 }
@@ -45,6 +68,11 @@ void ImgViewer::reactToFitWindowToggle(bool checked)
     }
 }
 
+void ImgViewer::reactToRoiModeToggle(bool checked)
+{
+    m_IsRoiMode = checked;
+}
+
 void ImgViewer::fitWindow()
 {
     if (m_image.isNull())
@@ -52,10 +80,10 @@ void ImgViewer::fitWindow()
 
     this->setDragMode(NoDrag);
     this->resetTransform();
-    QPixmap px = m_pixmap; // scale a copy to viewsize (scaling the original results in blurred image)
-    px = px.scaled(QSize(this->width(),this->height()),Qt::KeepAspectRatio,Qt::SmoothTransformation);
-    m_pixmapItem->setPixmap(px);
-    m_scene->setSceneRect(px.rect());
+    this->rotate(m_rotateAngle);
+    // tiles are picked at the level of detail of the view, so the scaled image stays sharp
+    this->fitInView(m_imageItem, Qt::KeepAspectRatio);
+    emit viewChanged();
 }
 
 void ImgViewer::originalSize()
@@ -64,10 +92,10 @@ void ImgViewer::originalSize()
         return;
 
     this->setDragMode(ScrollHandDrag);
-    m_pixmap = m_pixmap.scaled(QSize(m_image.width(),m_image.height()),Qt::KeepAspectRatio,Qt::SmoothTransformation);
-    m_pixmapItem->setPixmap(m_pixmap);
-    m_scene->setSceneRect(m_pixmap.rect());
-    this->centerOn(m_pixmapItem);
+    this->resetTransform();
+    this->rotate(m_rotateAngle);
+    this->centerOn(m_imageItem);
+    emit viewChanged();
 }
 
 void ImgViewer::rotateView(const int nVal)
@@ -87,6 +115,8 @@ void ImgViewer::rotateView(const int nVal)
     if (m_rotateAngle >= 360 || m_rotateAngle <= -360) {
         m_rotateAngle =0;
     }
+
+    emit viewChanged();
 }
 
 void ImgViewer::printView()
@@ -96,9 +126,12 @@ void ImgViewer::printView()
     }
 #ifndef QT_NO_PRINTER
     if (QPrintDialog(&printer).exec() == QDialog::Accepted) {
-        QPainter painter(&printer);
-        painter.setRenderHint(QPainter::Antialiasing);
-        m_scene->render(&painter);
+        finishRoiJob();
+
+        // rendering the whole scene at printer resolution needs the full
+        // rasterized page in memory, stream it in bands instead
+        BandPrinter job(&printer, m_image, m_rotateAngle, m_toneLut, this);
+        job.exec();
     }
 #endif
 }
@@ -120,6 +153,9 @@ bool ImgViewer::saveImageToDisk(QImage image, QString &_strFilePath, QString &st
          strFilePath += "."+fileFormat;
     }
 
+    // tone adjustments are only applied to the display until saved
+    image = algorithms::applyLut(image, m_toneLut);
+
     // save image in modified state
     if (isModified()) {
         QTransform t;
@@ -183,10 +219,18 @@ void ImgViewer::resizeEvent(QResizeEvent *event)
         fitWindow();
     } else {
         QGraphicsView::resizeEvent(event);  // call base implementation
-        this->centerOn(m_pixmapItem);
+        this->centerOn(m_imageItem);
+        emit viewChanged();
     }
 }
 
+// report panning, so synchronized views can follow
+void ImgViewer::scrollContentsBy(int dx, int dy)
+{
+    QGraphicsView::scrollContentsBy(dx, dy);
+    emit viewChanged();
+}
+
 // scale image on wheelEvent
 void ImgViewer::wheelEvent(QWheelEvent *event)
 {
@@ -207,26 +251,38 @@ void ImgViewer::wheelEvent(QWheelEvent *event)
     // scale  the View
     this->scale(factor,factor);
     event->accept();
+    emit viewChanged();
 }
 
 QImage ImgViewer::getImage() {
+    finishRoiJob();
     return m_image;
 }
 
-void ImgViewer::setImage(QImage image, QString strName) {
+// image as it was before any filter was applied
+QImage ImgViewer::getOriginalImage() {
+    return m_original;
+}
+
+void ImgViewer::setImage(QImage image, QString strName, QImage original) {
     resetView();
     m_fileName = strName;
     m_image = image;
+    m_original = original.isNull() ? image : original;
     drawChangedImage();
 }
 
 void ImgViewer::drawChangedImage()
 {
-    m_pixmap = QPixmap::fromImage(m_image);
-    m_pixmapItem = m_scene->addPixmap(m_pixmap); // add pixmap to scene and return pointer to pixmapItem
-    m_scene->setSceneRect(m_pixmap.rect());      // set scene rect to image
+    if (!m_imageItem) {
+        m_imageItem = new TiledImageItem();
+        m_imageItem->setLut(m_toneLut);
+        m_scene->addItem(m_imageItem);
+    }
+    m_imageItem->setImage(&m_image);
+    m_scene->setSceneRect(m_image.rect());       // set scene rect to image
 
-    this->centerOn(m_pixmapItem);                // ensure item is centered in the view.
+    this->centerOn(m_imageItem);                 // ensure item is centered in the view.
 
     // preserve fitWindow if activated
     if (m_IsFitWindow) {
@@ -240,53 +296,401 @@ void ImgViewer::drawChangedImage()
 
 void ImgViewer::applyRandomBlurAlgorithm()
 {
-    std::mt19937 mt_rand(time(0));
-    auto dice_rand = std::bind(std::uniform_int_distribution<int>(0, 4), mt_rand);
-    for (int i = 0; i < m_image.width(); ++i)
-    {
-        for (int j = 0; j < m_image.height(); ++j)
-        {
-            if (dice_rand() == 0)
-            {
-                int allR = 0;
-                int allG = 0;
-                int allB = 0;
-                int cnt = 0;
-                for (int ci = i - 3; ci <= i + 3; ++ci) {
-                    for (int cj = j - 3; cj <= j + 3; ++cj) {
-                        if (ci < 0 || cj < 0 || ci >= m_image.width() || cj >= m_image.height()) continue;
-                        allR += qRed(m_image.pixel(ci, cj));
-                        allG += qGreen(m_image.pixel(ci, cj));
-                        allB += qBlue(m_image.pixel(ci, cj));
-                        cnt++;
-                    }
-                }
-                allR /= cnt;
-                allG /= cnt;
-                allB /= cnt;
-                m_image.setPixel(i, j, qRgb(allR, allG, allB));
-            }
-        }
+    // one seed per run, so the tiles of a run agree with each other
+    const quint32 seed = std::random_device()();
+    applyFilter([seed](const QImage& image) {
+        return algorithms::randomBlur(image, seed);
+    }, 3, m_image.format());
+}
+
+void ImgViewer::applyCannyAlgorithm()
+{
+    if (m_image.isNull())
+        return;
+
+    finishRoiJob();
+    bakeToneAdjustment();
+    // hysteresis follows edges across the whole image, so never filter tile by tile
+    runFilter(m_image, [](const QImage& image) {
+        if (image.format() == QImage::Format_Grayscale8)
+            return algorithms::canny(image, 1, 40, 120);
+        // colour edges are lost in a grayscale conversion, use all channels
+        return algorithms::cannyColor(image, 1, 40, 120);
+    }, 0, QImage::Format_Grayscale8, false);
+}
+
+void ImgViewer::applyMultiScaleCanny()
+{
+    if (m_image.isNull())
+        return;
+
+    // coarsest level at most 1024 px, where page borders and gutters are a
+    // few pixels wide
+    int levels = 1;
+    for (int side = qMax(m_image.width(), m_image.height()); side > 1024 && levels < 6; side /= 2) {
+        levels++;
     }
 
-    drawChangedImage();
+    finishRoiJob();
+    bakeToneAdjustment();
+    // every level depends on the one above, so never filter tile by tile
+    runFilter(m_image, [levels](const QImage& image) {
+        return algorithms::multiScaleCanny(image, levels, 40, 120);
+    }, 0, QImage::Format_Grayscale8, false);
 }
 
-void ImgViewer::applyCannyAlgorithm()
+void ImgViewer::applyLocalMean()
 {
-    auto grayscale = m_image.convertToFormat(QImage::Format_Grayscale8);
-    m_image = algorithms::canny(grayscale, 1, 40, 120);
-    drawChangedImage();
+    const int radius = 7;
+    applyFilter([radius](const QImage& image) {
+        return algorithms::localMean(image.convertToFormat(QImage::Format_Grayscale8), radius);
+    }, radius, QImage::Format_Grayscale8);
+}
+
+void ImgViewer::applySauvolaBinarization()
+{
+    const int radius = 15;
+    applyFilter([radius](const QImage& image) {
+        return algorithms::sauvola(image.convertToFormat(QImage::Format_Grayscale8), radius, 0.34, 128);
+    }, radius, QImage::Format_Grayscale8);
+}
+
+void ImgViewer::applyNiblackBinarization()
+{
+    const int radius = 15;
+    applyFilter([radius](const QImage& image) {
+        return algorithms::niblack(image.convertToFormat(QImage::Format_Grayscale8), radius, -0.2);
+    }, radius, QImage::Format_Grayscale8);
+}
+
+void ImgViewer::applyMorphology(algorithms::MorphologyOperation operation, const QSize& element)
+{
+    // opening and closing run two passes, each reaching half the element
+    const int w = element.width();
+    const int h = element.height();
+    const int halo = qMax(w, h);
+    applyFilter([operation, w, h](const QImage& image) {
+        return algorithms::morphology(image.convertToFormat(QImage::Format_Grayscale8), operation, w, h);
+    }, halo, QImage::Format_Grayscale8);
+}
+
+void ImgViewer::applyMedianFilter()
+{
+    const int radius = 3;
+    applyFilter([radius](const QImage& image) {
+        return algorithms::medianFilter(image, radius);
+    }, radius, m_image.format());
+}
+
+void ImgViewer::applyBilateralFilter()
+{
+    // the grid blur reaches about four spatial sigmas
+    const double sigmaSpatial = 4;
+    applyFilter([sigmaSpatial](const QImage& image) {
+        return algorithms::bilateralFilter(image, sigmaSpatial, 25);
+    }, qCeil(4 * sigmaSpatial), m_image.format());
+}
+
+// Straighten the page by the detected text line angle, returns the angle
+double ImgViewer::applyDeskew()
+{
+    if (m_image.isNull())
+        return 0;
+
+    finishRoiJob();
+    bakeToneAdjustment();
+    const double angle = algorithms::detectSkew(m_image);
+    // the angle depends on the whole page, so never rotate tile by tile
+    runFilter(m_image, [angle](const QImage& image) {
+        return algorithms::rotate(image, -angle);
+    }, 0, m_image.format(), false);
+    return angle;
+}
+
+void ImgViewer::applyClahe()
+{
+    // the tone dialog stays open, but the image belongs to the Canny preview
+    if (m_image.isNull() || m_canny)
+        return;
+
+    finishRoiJob();
+    bakeToneAdjustment();
+    // tile tables depend on the whole image, so never filter tile by tile
+    runFilter(m_image, [](const QImage& image) {
+        return algorithms::clahe(image.convertToFormat(QImage::Format_Grayscale8), 8, 2.0);
+    }, 0, QImage::Format_Grayscale8, false);
 }
 
 QImage ImgViewer::applyGaborFilter(double theta)
 {
-    QImage grayscale = m_image.convertToFormat(QImage::Format_Grayscale8);
     double lambda = 3;
     double gamma = 0.1;
     double sigma = 0.56 * lambda;
     double phi = 0;
     auto kernel = algorithms::getGaborKernel(sigma, theta, lambda, gamma, phi);
-    auto result = algorithms::convolution(kernel, grayscale);
-    return result;
+
+    finishRoiJob();
+    bakeToneAdjustment();
+
+    // RGB32 and ARGB32 images are filtered on their luminance directly, without
+    // a grayscale copy; other 32-bit layouts are not QRgb values
+    if (m_image.format() == QImage::Format_Grayscale8)
+        return algorithms::convolution(kernel, m_image);
+    if (algorithms::isQRgbImage(m_image))
+        return algorithms::lumaConvolution(kernel, m_image);
+    return algorithms::convolution(kernel, m_image.convertToFormat(QImage::Format_Grayscale8));
+}
+
+void ImgViewer::applyFilter(RoiFilterJob::Filter filter, int halo, QImage::Format outFormat)
+{
+    if (m_image.isNull())
+        return;
+
+    finishRoiJob();
+    bakeToneAdjustment();
+    runFilter(m_image, filter, halo, outFormat, m_IsRoiMode);
+}
+
+// Filter the visible part of the image right away and the rest tile by tile
+// in the background (ROI mode), or the whole image at once otherwise.
+void ImgViewer::runFilter(const QImage& source, RoiFilterJob::Filter filter, int halo,
+                          QImage::Format outFormat, bool roi)
+{
+    if (!roi) {
+        m_image = filter(source).convertToFormat(outFormat);
+        updateImageItem();
+        return;
+    }
+
+    m_roiJob.reset(new RoiFilterJob(source, filter, halo, outFormat));
+
+    // tiles not reached yet keep showing the current image
+    if (m_image.size() != source.size() || m_image.format() != m_roiJob->outputFormat())
+        m_image = source.convertToFormat(m_roiJob->outputFormat());
+
+    QRect region = m_roiJob->takeRegion(visibleImageRect());
+    RoiFilterJob::commitRegion(m_image, region, m_roiJob->filterRegion(region));
+    updateImageItem();
+
+    scheduleNextRoiTile();
+}
+
+void ImgViewer::beginCannyTuning(double sigma, double tmin, double tmax, algorithms::Smoothing smoothing)
+{
+    // a second tuning would replace the input the first one restores on reject
+    if (m_image.isNull() || m_canny)
+        return;
+
+    finishRoiJob();
+    bakeToneAdjustment();
+    m_cannyInput = m_image;
+    m_canny.reset(new algorithms::CannyPipeline(m_image.convertToFormat(QImage::Format_Grayscale8),
+                                                sigma, tmin, tmax, smoothing));
+    updateCannyResult();
+}
+
+void ImgViewer::setCannyParameters(double sigma, double tmin, double tmax)
+{
+    if (!m_canny)
+        return;
+
+    m_canny->setSigma(sigma);
+    m_canny->setThresholds(tmin, tmax);
+    updateCannyResult();
+}
+
+void ImgViewer::setCannySmoothing(int smoothing)
+{
+    if (!m_canny)
+        return;
+
+    m_canny->setSmoothing(static_cast<algorithms::Smoothing>(smoothing));
+    updateCannyResult();
+}
+
+// Rerun hysteresis on the visible tiles now and on the rest in the background;
+// blur, gradients and suppression are only recomputed after a sigma change.
+void ImgViewer::updateCannyResult()
+{
+    cancelRoiJob();
+
+    const double tmin = m_canny->tmin();
+    const double tmax = m_canny->tmax();
+    runFilter(m_canny->suppressed(), [tmin, tmax](const QImage& nms) {
+        return algorithms::hysteresis(nms, tmin, tmax);
+    }, algorithms::CannyPipeline::HysteresisHalo, QImage::Format_Grayscale8, true);
+}
+
+void ImgViewer::acceptCannyTuning()
+{
+    if (!m_canny)
+        return;
+
+    // the preview runs hysteresis tile by tile, the accepted map on the whole image
+    cancelRoiJob();
+    m_image = m_canny->result();
+    m_canny.reset();
+    m_cannyInput = QImage();
+    updateImageItem();
+}
+
+void ImgViewer::rejectCannyTuning()
+{
+    if (!m_canny)
+        return;
+
+    cancelRoiJob();
+    m_canny.reset();
+    m_image = m_cannyInput;
+    m_cannyInput = QImage();
+    updateImageItem();
+}
+
+// Point adjustments are shown through the tile LUT; the image itself is
+// left alone until it is saved or handed to a filter
+void ImgViewer::setToneLut(const QVector<quint8>& lut)
+{
+    m_toneLut = algorithms::isIdentity(lut) ? algorithms::Lut() : lut;
+    if (m_imageItem)
+        m_imageItem->setLut(m_toneLut);
+}
+
+void ImgViewer::bakeToneAdjustment()
+{
+    if (m_toneLut.isEmpty())
+        return;
+
+    m_image = algorithms::applyLut(m_image, m_toneLut);
+    setToneLut(algorithms::Lut());
+    updateImageItem();
+}
+
+// refresh the displayed image without touching the view transform
+void ImgViewer::updateImageItem()
+{
+    m_imageItem->setImage(&m_image);
+    m_scene->setSceneRect(m_image.rect());
+
+    if (m_IsFitWindow) {
+        fitWindow();
+    }
+}
+
+// Blend or swipe a second image of the same size over the displayed one
+void ImgViewer::setOverlayImage(const QImage& image)
+{
+    if (m_image.isNull())
+        return;
+
+    m_overlay = image;
+    if (m_overlay.isNull()) {
+        delete m_overlayItem;
+        m_overlayItem = 0;
+        return;
+    }
+
+    if (!m_overlayItem) {
+        m_overlayItem = new TiledImageItem();
+        m_overlayItem->setZValue(1);
+        m_scene->addItem(m_overlayItem);
+    }
+    m_overlayItem->setImage(&m_overlay);
+}
+
+void ImgViewer::setOverlayOpacity(qreal opacity)
+{
+    if (m_overlayItem)
+        m_overlayItem->setOpacity(opacity);
+}
+
+void ImgViewer::setOverlaySwipe(qreal fraction)
+{
+    if (m_overlayItem)
+        m_overlayItem->setClipFraction(fraction);
+}
+
+// part of the image currently shown in the viewport, in image coordinates
+QRect ImgViewer::visibleImageRect() const
+{
+    QRectF visible = mapToScene(viewport()->rect()).boundingRect();
+    return visible.toAlignedRect().intersected(m_image.rect());
+}
+
+void ImgViewer::scheduleNextRoiTile()
+{
+    if (!m_roiJob)
+        return;
+
+    if (m_roiJob->isDone()) {
+        endRoiJob();
+        updateImageItem();
+        return;
+    }
+
+    // the visible rect is queried for every tile, so tiles scrolled into view jump the queue
+    m_roiTile = m_roiJob->takeNextTile(visibleImageRect());
+
+    const RoiFilterJob *job = m_roiJob.data();
+    const QRect tile = m_roiTile;
+    m_roiWatcher.setFuture(QtConcurrent::run([job, tile]() {
+        return job->filterRegion(tile);
+    }));
+}
+
+void ImgViewer::roiTileFinished()
+{
+    if (!m_roiJob || m_roiTile.isNull())
+        return;
+
+    QImage filtered = m_roiWatcher.result();
+    RoiFilterJob::commitRegion(m_image, m_roiTile, filtered);
+    m_imageItem->imageChanged(m_roiTile);
+    m_roiTile = QRect();
+
+    scheduleNextRoiTile();
+}
+
+// complete a running background job, so the next filter sees the whole result
+void ImgViewer::finishRoiJob()
+{
+    if (!m_roiJob)
+        return;
+
+    m_roiWatcher.waitForFinished();
+    if (!m_roiTile.isNull()) {
+        RoiFilterJob::commitRegion(m_image, m_roiTile, m_roiWatcher.result());
+        m_roiTile = QRect();
+    }
+
+    QVector<QRect> tiles;
+    while (!m_roiJob->isDone()) {
+        tiles.append(m_roiJob->takeNextTile(m_image.rect()));
+    }
+
+    const RoiFilterJob *job = m_roiJob.data();
+    QVector<QImage> results = QtConcurrent::blockingMapped<QVector<QImage>>(tiles, [job](const QRect& tile) {
+        return job->filterRegion(tile);
+    });
+    for (int i = 0; i < tiles.size(); i++) {
+        RoiFilterJob::commitRegion(m_image, tiles[i], results[i]);
+    }
+
+    endRoiJob();
+    updateImageItem();
+}
+
+// tiles are committed in the output format of the job, the finished image
+// is converted to the format asked for once
+void ImgViewer::endRoiJob()
+{
+    if (m_image.format() != m_roiJob->targetFormat())
+        m_image = m_image.convertToFormat(m_roiJob->targetFormat());
+    m_roiJob.reset();
+}
+
+void ImgViewer::cancelRoiJob()
+{
+    m_roiWatcher.waitForFinished();
+    m_roiTile = QRect();
+    m_roiJob.reset();
 }
@@ -3,10 +3,19 @@
 
 #include <QGraphicsView>
 #include <QGraphicsScene>
-#include <QPixmap>
-#include <QGraphicsPixmapItem>
 #include <QImage>
 #include <QPrinter>
+#include <QFutureWatcher>
+#include <QScopedPointer>
+#include "roifilter.h"
+#include "tiledimageitem.h"
+#include "morphology.h"
+#include "denoise.h"
+#include "tone.h"
+
+namespace algorithms {
+    class CannyPipeline;
+}
 
 
 class ImgViewer : public QGraphicsView
@@ -16,6 +25,7 @@ class ImgViewer : public QGraphicsView
 
 public:
     explicit ImgViewer(QWidget *parent = 0);
+    ~ImgViewer();
 
     void resetView();
     void fitWindow();
@@ -30,21 +40,58 @@ public:
     QString getImageFormat(QString strFileName);
 
     QImage getImage();
-    void setImage(QImage image, QString strName);
+    QImage getOriginalImage();
+    void setImage(QImage image, QString strName, QImage original = QImage());
     void drawChangedImage();
     void applyCannyAlgorithm();
+    void applyMultiScaleCanny();
     void applyRandomBlurAlgorithm();
     QImage applyGaborFilter(double theta);
+    void applyLocalMean();
+    void applySauvolaBinarization();
+    void applyNiblackBinarization();
+    void applyMorphology(algorithms::MorphologyOperation operation, const QSize& element);
+    void applyMedianFilter();
+    void applyBilateralFilter();
+    double applyDeskew();
+    void applyClahe();
+    algorithms::Lut toneLut() const { return m_toneLut; }
+    void applyFilter(RoiFilterJob::Filter filter, int halo, QImage::Format outFormat);
+    void beginCannyTuning(double sigma, double tmin, double tmax,
+                          algorithms::Smoothing smoothing = algorithms::Smoothing::Gaussian);
+    void setOverlayImage(const QImage& image);
+    void setOverlayOpacity(qreal opacity);
+    void setOverlaySwipe(qreal fraction);
 
 private:
     mutable QImage m_image;
-    QPixmap m_pixmap;
-    QGraphicsPixmapItem *m_pixmapItem;
+    QImage m_original;
+    QImage m_overlay;
+    TiledImageItem *m_imageItem;
+    TiledImageItem *m_overlayItem;
     QGraphicsScene *m_scene;
     int m_rotateAngle;
     bool m_IsFitWindow;
     bool m_IsViewInitialized;
     QString m_fileName;
+    bool m_IsRoiMode;
+    QScopedPointer<RoiFilterJob> m_roiJob;
+    QFutureWatcher<QImage> m_roiWatcher;
+    QRect m_roiTile;
+    QScopedPointer<algorithms::CannyPipeline> m_canny;
+    QImage m_cannyInput;
+    algorithms::Lut m_toneLut;
+
+    void runFilter(const QImage& source, RoiFilterJob::Filter filter, int halo,
+                   QImage::Format outFormat, bool roi);
+    void updateCannyResult();
+    void bakeToneAdjustment();
+    void updateImageItem();
+    QRect visibleImageRect() const;
+    void scheduleNextRoiTile();
+    void finishRoiJob();
+    void endRoiJob();
+    void cancelRoiJob();
 
 #ifndef QT_NO_PRINTER
     QPrinter printer;
@@ -54,10 +101,23 @@ private:
 protected:
     virtual void wheelEvent(QWheelEvent * event);
     virtual void resizeEvent(QResizeEvent * event);
+    virtual void scrollContentsBy(int dx, int dy);
+
+signals:
+    void viewChanged();
 
 
 public slots:
     void reactToFitWindowToggle(bool);
+    void reactToRoiModeToggle(bool);
+    void setCannyParameters(double sigma, double tmin, double tmax);
+    void setCannySmoothing(int smoothing);
+    void setToneLut(const QVector<quint8>& lut);
+    void acceptCannyTuning();
+    void rejectCannyTuning();
+
+private slots:
+    void roiTileFinished();
 
 };
 
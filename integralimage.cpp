@@ -0,0 +1,140 @@
+#include <QtWidgets>
+#include <cstring>
+#include "integralimage.h"
+#include "parallel.h"
+#include "bufferpool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace algorithms
+{
+    // Running sum of one image row (or of its squares) into dst[1..width]
+    static void prefixRow(const quint8 *src, quint64 *dst, int width, bool squares) {
+        quint64 carry = 0;
+        int x = 0;
+        dst[0] = 0;
+
+#ifdef __SSE2__
+        // four pixels at a time: in-register prefix sum in 32 bit, then widened
+        // to 64 bit and offset by the sum of everything to the left
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 4 <= width; x += 4) {
+            quint32 packed;
+            memcpy(&packed, src + x, 4);
+            __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+            if (squares)
+                v = _mm_madd_epi16(v, v);
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+
+            const __m128i c = _mm_set1_epi64x(carry);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x + 1), _mm_add_epi64(_mm_unpacklo_epi32(v, zero), c));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x + 3), _mm_add_epi64(_mm_unpackhi_epi32(v, zero), c));
+            carry = dst[x + 4];
+        }
+#endif
+
+        for (; x < width; x++) {
+            carry += squares ? src[x] * src[x] : src[x];
+            dst[x + 1] = carry;
+        }
+    }
+
+    static void buildTable(const QImage& image, PooledArray<quint64>& table, bool squares) {
+        const int width = image.width();
+        const int height = image.height();
+        const int stride = width + 1;
+        // every other row is written by prefixRow, including its leading zero
+        table.resize(size_t(stride) * (height + 1));
+        quint64 *data = table.data();
+        std::fill(data, data + stride, 0);
+
+        // rows are independent for the horizontal pass
+        parallelBands(height, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                prefixRow(image.constScanLine(y), data + size_t(y + 1) * stride, width, squares);
+            }
+        });
+
+        // and columns for the vertical one
+        parallelBands(stride, [&](int begin, int end) {
+            for (int y = 2; y <= height; y++) {
+                quint64 *row = data + size_t(y) * stride;
+                const quint64 *prev = row - stride;
+                for (int x = begin; x < end; x++) {
+                    row[x] += prev[x];
+                }
+            }
+        }, 256);
+    }
+
+    IntegralImage::IntegralImage(const QImage& grayscale, bool squares) :
+        m_width(grayscale.width()), m_height(grayscale.height())
+    {
+        buildTable(grayscale, m_sum, false);
+        if (squares)
+            buildTable(grayscale, m_sqsum, true);
+    }
+
+
+    // Mean of the (2 * radius + 1)^2 window around each pixel
+    QImage localMean(const QImage& input, int radius) {
+        IntegralImage integral(input);
+        QImage res = pooledImage(input.size(), QImage::Format_Grayscale8);
+
+        const ImageRows resRows(res);
+        parallelBands(input.height(), [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                quint8 *line = resRows[y];
+                for (int x = 0; x < input.width(); x++) {
+                    QRect window = integral.window(x, y, radius);
+                    quint64 area = quint64(window.width()) * window.height();
+                    line[x] = static_cast<quint8>((integral.sum(window) + area / 2) / area);
+                }
+            }
+        });
+
+        return res;
+    }
+
+    // Binarize with a per-pixel threshold computed from the window mean and deviation
+    template<class Threshold>
+    static QImage adaptiveThreshold(const QImage& input, int radius, Threshold threshold) {
+        IntegralImage integral(input, true);
+        QImage res = pooledImage(input.size(), QImage::Format_Grayscale8);
+
+        const ImageRows resRows(res);
+        parallelBands(input.height(), [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                const quint8 *src = input.constScanLine(y);
+                quint8 *line = resRows[y];
+                for (int x = 0; x < input.width(); x++) {
+                    QRect window = integral.window(x, y, radius);
+                    double area = double(window.width()) * window.height();
+                    double mean = integral.sum(window) / area;
+                    double variance = integral.squareSum(window) / area - mean * mean;
+                    double deviation = std::sqrt(qMax(0.0, variance));
+                    line[x] = src[x] > threshold(mean, deviation) ? 0xFF : 0x00;
+                }
+            }
+        });
+
+        return res;
+    }
+
+    // T = m + k * s
+    QImage niblack(const QImage& input, int radius, double k) {
+        return adaptiveThreshold(input, radius, [k](double mean, double deviation) {
+            return mean + k * deviation;
+        });
+    }
+
+    // T = m * (1 + k * (s / R - 1)), R is the dynamic range of the deviation
+    QImage sauvola(const QImage& input, int radius, double k, double r) {
+        return adaptiveThreshold(input, radius, [k, r](double mean, double deviation) {
+            return mean * (1 + k * (deviation / r - 1));
+        });
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef INTEGRALIMAGE_H
+#define INTEGRALIMAGE_H
+
+#include <QImage>
+#include <QRect>
+#include "bufferpool.h"
+
+namespace algorithms
+{
+    // Summed-area table of a Grayscale8 image (and optionally of its squares).
+    // Sums are 64 bit, so any window of any image size can be queried in O(1).
+    // The tables live in pooled memory, the class is not copyable.
+    class IntegralImage
+    {
+    public:
+        IntegralImage() : m_width(0), m_height(0) {}
+        explicit IntegralImage(const QImage& grayscale, bool squares = false);
+
+        int width() const { return m_width; }
+        int height() const { return m_height; }
+        bool hasSquares() const { return !m_sqsum.empty(); }
+
+        // rect must lie inside the image
+        quint64 sum(const QRect& rect) const {
+            return at(m_sum, rect);
+        }
+
+        quint64 squareSum(const QRect& rect) const {
+            return at(m_sqsum, rect);
+        }
+
+        // window of the given radius around (x, y), clipped to the image
+        QRect window(int x, int y, int radius) const {
+            return QRect(QPoint(qMax(0, x - radius), qMax(0, y - radius)),
+                         QPoint(qMin(m_width - 1, x + radius), qMin(m_height - 1, y + radius)));
+        }
+
+    private:
+        quint64 at(const PooledArray<quint64>& table, const QRect& rect) const {
+            const int stride = m_width + 1;
+            const quint64 *top = table.data() + qint64(rect.top()) * stride;
+            const quint64 *bottom = table.data() + qint64(rect.bottom() + 1) * stride;
+            return bottom[rect.right() + 1] - bottom[rect.left()] - top[rect.right() + 1] + top[rect.left()];
+        }
+
+        int m_width;
+        int m_height;
+        PooledArray<quint64> m_sum;
+        PooledArray<quint64> m_sqsum;
+    };
+
+    QImage localMean(const QImage&, int);
+    QImage niblack(const QImage&, int, double);
+    QImage sauvola(const QImage&, int, double, double);
+}
+
+#endif // INTEGRALIMAGE_H
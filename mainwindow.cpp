@@ -1,6 +1,11 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "aboutdlg.h"
+#include "cannydlg.h"
+#include "bufferpool.h"
+#include "comparedlg.h"
+#include "morphologydlg.h"
+#include "tonedlg.h"
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QFileInfo>
@@ -26,9 +31,20 @@ MainWindow::MainWindow(QWidget *parent) :
 
     ui->statusBar->addWidget(m_infoLabel);
 
+    // memory held by the open pages, next to the file info
+    m_memoryLabel = new QLabel(this);
+    m_memoryLabel->setStyleSheet("QLabel {padding-left:3px;}");
+    ui->statusBar->addWidget(m_memoryLabel);
+
+    // statusbar info right (buffer pool usage)
+    m_poolLabel = new QLabel(this);
+    m_poolLabel->setStyleSheet("QLabel {padding-right:3px;}");
+    ui->statusBar->addPermanentWidget(m_poolLabel);
+
     connect(ui->actionOpen, SIGNAL(triggered()), this, SLOT(openImage()));   
     connect(ui->actionClear, SIGNAL(triggered()), this, SLOT(closeImage()));
     connect(ui->actionFitWindow, SIGNAL(toggled(bool)), ui->graphicsView, SLOT(reactToFitWindowToggle(bool)));  
+    connect(ui->actionRoiMode, SIGNAL(toggled(bool)), ui->graphicsView, SLOT(reactToRoiModeToggle(bool)));
     connect(ui->actionPrint, SIGNAL(triggered()), this, SLOT(printImage()));   
     connect(ui->actionSave,SIGNAL(triggered()), this, SLOT(saveImage()));    
     connect(ui->actionRotate_Left, SIGNAL(triggered()), this, SLOT(rotateImage())); 
@@ -48,10 +64,25 @@ void MainWindow::enableControls(bool bEnable)
     ui->actionPrint->setEnabled(bEnable);
     ui->actionRotate_Left->setEnabled(bEnable);
     ui->actionRotate_right->setEnabled(bEnable);
+    ui->actionDeskew->setEnabled(bEnable);
     ui->actionSave->setEnabled(bEnable);
     ui->actionFitWindow->setEnabled(bEnable);
 }
 
+// actions that replace the image or start a filter, off while a filter is tuned
+void MainWindow::enableFilterActions(bool bEnable)
+{
+    foreach (QAction *action, ui->menuFilters->actions()) {
+        action->setEnabled(bEnable);
+    }
+    ui->actionDeskew->setEnabled(bEnable);
+    ui->actionGarborFilter->setEnabled(bEnable);
+    ui->actionOpen->setEnabled(bEnable);
+    ui->actionopenSeveralImages->setEnabled(bEnable);
+    ui->actionNextImage->setEnabled(bEnable);
+    ui->actionClear->setEnabled(bEnable);
+}
+
 void MainWindow::openImages()
 {
     auto strFiles = QFileDialog::getOpenFileNames(
@@ -74,9 +105,10 @@ bool MainWindow::loadFile(QString strFilePath, QString &errStr) {
     }
 
     ui->graphicsView->setImage(image, strFilePath);
-    images.emplace_back(image, strFilePath);
+    images.append(image, strFilePath);
 
     updateStatusBarInfo(strFilePath);
+    updateMemoryInfo();
     enableControls(true);
 
     return true;
@@ -105,6 +137,7 @@ void MainWindow::openImage()
                 tr("Images (*.png *.jpg *.bmp *.tiff *.tif)"));
 
     images.clear();
+    updateMemoryInfo();
     openImage(strFilePath);
 }
 
@@ -117,6 +150,7 @@ void MainWindow::closeImage()
 {
     ui->graphicsView->resetView();
     m_infoLabel->setText("");
+    m_memoryLabel->setText("");
     enableControls(false);
 }
 
@@ -142,18 +176,18 @@ void MainWindow::rotateImage()
     }
 }
 
-QString MainWindow::formatByteSize(int nBytes)
+QString MainWindow::formatByteSize(qint64 nBytes)
 {
-    int B = 1;
-    int KB = 1024 * B;
-    int MB = 1024 * KB;
-    int GB = 1024 * MB;
+    qint64 B = 1;
+    qint64 KB = 1024 * B;
+    qint64 MB = 1024 * KB;
+    qint64 GB = 1024 * MB;
     QString str;
 
-    if(nBytes > GB)         str = QString::number(nBytes/GB, 'f', 2) + " GB";
-    else if(nBytes > MB)    str = QString::number(nBytes/MB, 'f', 2) + " MB";
-    else if(nBytes > KB)    str = QString::number(nBytes/KB, 'f', 2) + " KB";
-    else                    str = QString::number(nBytes, 'f', 2) + " B";
+    if(nBytes > GB)         str = QString::number(double(nBytes)/GB, 'f', 2) + " GB";
+    else if(nBytes > MB)    str = QString::number(double(nBytes)/MB, 'f', 2) + " MB";
+    else if(nBytes > KB)    str = QString::number(double(nBytes)/KB, 'f', 2) + " KB";
+    else                    str = QString::number(nBytes) + " B";
 
     return str;
 }
@@ -166,6 +200,23 @@ void MainWindow::updateStatusBarInfo(QString strFile)
     m_infoLabel->setText(strStatusInfo);
 }
 
+void MainWindow::updateMemoryInfo()
+{
+    auto usage = images.usage();
+    m_memoryLabel->setText(tr("Pages: %1 in memory (%2 compressed) / %3 uncompressed")
+                           .arg(formatByteSize(usage.decompressedBytes + usage.compressedBytes))
+                           .arg(formatByteSize(usage.compressedBytes))
+                           .arg(formatByteSize(usage.rawBytes)));
+}
+
+void MainWindow::updateBufferPoolInfo()
+{
+    auto stats = algorithms::BufferPool::instance().statistics();
+    m_poolLabel->setText(tr("Buffers: %1 reused / %2 allocated")
+                         .arg(formatByteSize(stats.reusedBytes))
+                         .arg(formatByteSize(stats.allocatedBytes)));
+}
+
 void MainWindow::on_actionAbout_triggered()
 {
     AboutDlg dlg(this);
@@ -176,9 +227,43 @@ void MainWindow::on_actionApplyKanny_triggered()
 {
     std::cout << "Apply Canny algorithm..." << std::endl;
     ui->graphicsView->applyCannyAlgorithm();
+    updateBufferPoolInfo();
     std::cout << "Canny algorithm applied." << std::endl;
 }
 
+void MainWindow::on_actionTuneCanny_triggered()
+{
+    // modeless, so the image can be zoomed and panned while tuning; nothing
+    // else may replace the image until the dialog is closed
+    CannyDlg *dlg = new CannyDlg(this);
+    dlg->setAttribute(Qt::WA_DeleteOnClose);
+    enableFilterActions(false);
+
+    ui->graphicsView->beginCannyTuning(dlg->sigma(), dlg->tmin(), dlg->tmax(), dlg->smoothing());
+    connect(dlg, SIGNAL(parametersChanged(double,double,double)),
+            ui->graphicsView, SLOT(setCannyParameters(double,double,double)));
+    connect(dlg, SIGNAL(smoothingChanged(int)), ui->graphicsView, SLOT(setCannySmoothing(int)));
+    connect(dlg, SIGNAL(accepted()), ui->graphicsView, SLOT(acceptCannyTuning()));
+    connect(dlg, SIGNAL(finished(int)), this, SLOT(updateBufferPoolInfo()));
+    connect(dlg, SIGNAL(rejected()), ui->graphicsView, SLOT(rejectCannyTuning()));
+    connect(dlg, SIGNAL(finished(int)), this, SLOT(endCannyTuning()));
+
+    dlg->show();
+}
+
+void MainWindow::endCannyTuning()
+{
+    enableFilterActions(true);
+}
+
+void MainWindow::on_actionMultiScaleCanny_triggered()
+{
+    std::cout << "Apply multi-scale Canny..." << std::endl;
+    ui->graphicsView->applyMultiScaleCanny();
+    updateBufferPoolInfo();
+    std::cout << "Multi-scale Canny applied." << std::endl;
+}
+
 void MainWindow::on_actionGarborFilter_triggered()
 {
     std::cout << "Apply Gabor filter..." << std::endl;
@@ -186,6 +271,7 @@ void MainWindow::on_actionGarborFilter_triggered()
     double ang = 0;
     double cut = M_PI / 6;
 
+    QImage original = ui->graphicsView->getImage();
     images.clear();
     curImage = 0;
 
@@ -195,33 +281,148 @@ void MainWindow::on_actionGarborFilter_triggered()
         QString resFile = QStringLiteral("../results/res%1").arg(i);
         ui->graphicsView->saveImageToDisk(resImage, resFile, sErr);
         std::cout << resFile.toStdString() << ": " << sErr.toStdString() << std::endl;
-        images.emplace_back(resImage, resFile);
+        images.append(resImage, resFile, original);
     }
 
     updateCurrentImage();
+    updateBufferPoolInfo();
 
     std::cout << "Gabor filter applied..." << std::endl;
 }
 
+void MainWindow::on_actionLocalMean_triggered()
+{
+    ui->graphicsView->applyLocalMean();
+    updateBufferPoolInfo();
+}
+
+void MainWindow::on_actionSauvola_triggered()
+{
+    ui->graphicsView->applySauvolaBinarization();
+    updateBufferPoolInfo();
+}
+
+void MainWindow::on_actionNiblack_triggered()
+{
+    ui->graphicsView->applyNiblackBinarization();
+    updateBufferPoolInfo();
+}
+
+void MainWindow::on_actionDeskew_triggered()
+{
+    std::cout << "Deskew..." << std::endl;
+    const double angle = ui->graphicsView->applyDeskew();
+    updateBufferPoolInfo();
+    std::cout << "Page rotated by " << -angle << " degrees." << std::endl;
+}
+
+void MainWindow::on_actionMedian_triggered()
+{
+    ui->graphicsView->applyMedianFilter();
+    updateBufferPoolInfo();
+}
+
+void MainWindow::on_actionBilateral_triggered()
+{
+    ui->graphicsView->applyBilateralFilter();
+    updateBufferPoolInfo();
+}
+
+void MainWindow::on_actionErode_triggered()
+{
+    ui->graphicsView->applyMorphology(algorithms::MorphologyOperation::Erode, m_element);
+    updateBufferPoolInfo();
+}
+
+void MainWindow::on_actionDilate_triggered()
+{
+    ui->graphicsView->applyMorphology(algorithms::MorphologyOperation::Dilate, m_element);
+    updateBufferPoolInfo();
+}
+
+void MainWindow::on_actionOpen_Morphology_triggered()
+{
+    ui->graphicsView->applyMorphology(algorithms::MorphologyOperation::Open, m_element);
+    updateBufferPoolInfo();
+}
+
+void MainWindow::on_actionClose_Morphology_triggered()
+{
+    ui->graphicsView->applyMorphology(algorithms::MorphologyOperation::Close, m_element);
+    updateBufferPoolInfo();
+}
+
+void MainWindow::on_actionStructuringElement_triggered()
+{
+    MorphologyDlg dlg(m_element, this);
+    if (dlg.exec() == QDialog::Accepted) {
+        m_element = dlg.element();
+        std::cout << "Structuring element " << m_element.width() << "x" << m_element.height() << std::endl;
+    }
+}
+
+void MainWindow::on_actionTone_triggered()
+{
+    QImage image = ui->graphicsView->getImage();
+    if (image.isNull())
+        return;
+
+    // modeless, the adjustment is previewed on the tiles as the sliders move
+    ToneDlg *dlg = new ToneDlg(algorithms::histogram(image), ui->graphicsView->toneLut(), this);
+    dlg->setAttribute(Qt::WA_DeleteOnClose);
+
+    connect(dlg, SIGNAL(lutChanged(QVector<quint8>)), ui->graphicsView, SLOT(setToneLut(QVector<quint8>)));
+    connect(dlg, SIGNAL(claheRequested()), this, SLOT(applyClahe()));
+
+    dlg->show();
+}
+
+void MainWindow::applyClahe()
+{
+    std::cout << "Apply CLAHE..." << std::endl;
+    ui->graphicsView->applyClahe();
+    updateBufferPoolInfo();
+
+    if (ToneDlg *dlg = qobject_cast<ToneDlg*>(sender()))
+        dlg->setHistogram(algorithms::histogram(ui->graphicsView->getImage()));
+    std::cout << "CLAHE applied." << std::endl;
+}
+
 void MainWindow::on_actionopenSeveralImages_triggered()
 {
     std::cout << "Open several images:" << std::endl;
     images.clear();
+    updateMemoryInfo();
     curImage = 0;
     openImages();
 }
 
 void MainWindow::updateCurrentImage() {
-    if (images.empty()) return;
-    ui->graphicsView->setImage(images[curImage].image, images[curImage].name);
-    updateStatusBarInfo(images[curImage].name);
-    std::cout << "updateCurrentImage: " << images[curImage].name.toStdString() << std::endl;
+    if (images.isEmpty()) return;
+    // compresses pages that left the prefetch window, prefetches the next ones
+    images.setActive(curImage);
+    ui->graphicsView->setImage(images.image(curImage), images.name(curImage), images.original(curImage));
+    updateStatusBarInfo(images.name(curImage));
+    updateMemoryInfo();
+    std::cout << "updateCurrentImage: " << images.name(curImage).toStdString() << std::endl;
 }
 
 void MainWindow::on_actionNextImage_triggered()
 {
-    if (images.empty()) return;
-    curImage = (curImage + 1) % images.size();
+    if (images.isEmpty()) return;
+    curImage = (curImage + 1) % images.count();
     std::cout << "increment curImage: " << curImage << std::endl;
     updateCurrentImage();
 }
+
+void MainWindow::on_actionCompare_triggered()
+{
+    QImage filtered = ui->graphicsView->getImage();
+    if (filtered.isNull())
+        return;
+
+    CompareDlg *dlg = new CompareDlg(ui->graphicsView->getOriginalImage(), filtered,
+                                     images.isEmpty() ? QString() : images.name(curImage), this);
+    dlg->setAttribute(Qt::WA_DeleteOnClose);
+    dlg->show();
+}
@@ -3,6 +3,7 @@
 
 #include <QMainWindow>
 #include <QLabel>
+#include "pagestore.h"
 
 
 namespace Ui {
@@ -19,26 +20,25 @@ public:
 private:
     Ui::MainWindow *ui;
     QLabel *m_infoLabel;
-    QString formatByteSize(int nBytes);
+    QLabel *m_memoryLabel;
+    QLabel *m_poolLabel;
+    QString formatByteSize(qint64 nBytes);
     void enableControls(bool bEnable);
+    void enableFilterActions(bool bEnable);
     void updateStatusBarInfo(QString strFile);
+    void updateMemoryInfo();
 
-    struct ImageName {
-        QImage image;
-        QString name;
-        ImageName() {}
-        ImageName(QImage image, QString name) : image(image), name(name) {}
-        ImageName(QImage &&image, QString &&name) : image(image), name(name) {}
-    };
-
-    std::vector<ImageName> images;
+    PageStore images;
     int curImage = 0;
+    // structuring element of the morphology actions
+    QSize m_element = QSize(3, 3);
 
     bool loadFile(QString strFilePath, QString &strErr);
     void openImage(QString strFilePath);
     void updateCurrentImage();
 
 private slots:
+    void updateBufferPoolInfo();
     void openImage();
     void openImages();
     void closeImage();
@@ -47,9 +47,26 @@ private slots:
     void rotateImage();
     void on_actionAbout_triggered();
     void on_actionApplyKanny_triggered();
+    void on_actionTuneCanny_triggered();
+    void endCannyTuning();
+    void on_actionMultiScaleCanny_triggered();
     void on_actionGarborFilter_triggered();
+    void on_actionLocalMean_triggered();
+    void on_actionSauvola_triggered();
+    void on_actionNiblack_triggered();
+    void on_actionDeskew_triggered();
+    void on_actionMedian_triggered();
+    void on_actionBilateral_triggered();
+    void on_actionErode_triggered();
+    void on_actionDilate_triggered();
+    void on_actionOpen_Morphology_triggered();
+    void on_actionClose_Morphology_triggered();
+    void on_actionStructuringElement_triggered();
+    void on_actionTone_triggered();
+    void applyClahe();
     void on_actionopenSeveralImages_triggered();
     void on_actionNextImage_triggered();
+    void on_actionCompare_triggered();
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,347 @@
+#include <QtWidgets>
+#include <algorithm>
+#include <cstring>
+#include "morphology.h"
+#include "parallel.h"
+#include "bufferpool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace algorithms
+{
+    // Element wise operations on rows; identity is the value of pixels outside the image
+    struct MaxOp {
+        typedef quint8 Type;
+        static quint8 identity() { return 0x00; }
+        static quint8 op(quint8 a, quint8 b) { return qMax(a, b); }
+        static void rows(const quint8 *a, const quint8 *b, quint8 *dst, int n) {
+            int x = 0;
+#ifdef __SSE2__
+            for (; x + 16 <= n; x += 16) {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_max_epu8(va, vb));
+            }
+#endif
+            for (; x < n; x++) {
+                dst[x] = op(a[x], b[x]);
+            }
+        }
+    };
+
+    struct MinOp {
+        typedef quint8 Type;
+        static quint8 identity() { return 0xFF; }
+        static quint8 op(quint8 a, quint8 b) { return qMin(a, b); }
+        static void rows(const quint8 *a, const quint8 *b, quint8 *dst, int n) {
+            int x = 0;
+#ifdef __SSE2__
+            for (; x + 16 <= n; x += 16) {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_min_epu8(va, vb));
+            }
+#endif
+            for (; x < n; x++) {
+                dst[x] = op(a[x], b[x]);
+            }
+        }
+    };
+
+    struct OrOp {
+        typedef quint64 Type;
+        static quint64 identity() { return 0; }
+        static quint64 op(quint64 a, quint64 b) { return a | b; }
+        static void rows(const quint64 *a, const quint64 *b, quint64 *dst, int n) {
+            for (int x = 0; x < n; x++) {
+                dst[x] = a[x] | b[x];
+            }
+        }
+    };
+
+    struct AndOp {
+        typedef quint64 Type;
+        static quint64 identity() { return ~Q_UINT64_C(0); }
+        static quint64 op(quint64 a, quint64 b) { return a & b; }
+        static void rows(const quint64 *a, const quint64 *b, quint64 *dst, int n) {
+            for (int x = 0; x < n; x++) {
+                dst[x] = a[x] & b[x];
+            }
+        }
+    };
+
+
+    // van Herk/Gil-Werman over a column of rows: every output row is the op of
+    // the k source rows centered on it, using per block prefix (g) and suffix (h)
+    // results, so each output costs three row operations whatever k is.
+    template<class Op>
+    static void verticalPass(const typename Op::Type *src, size_t srcStride,
+                             typename Op::Type *dst, size_t dstStride, int height, int len, int k) {
+        typedef typename Op::Type T;
+        const int r = k / 2;
+
+        parallelBands(height, [&](int begin, int end) {
+            const int count = end - begin + k - 1;
+            const int padded = (count + k - 1) / k * k;
+            std::vector<T> g(size_t(padded) * len);
+            std::vector<T> h(size_t(padded) * len);
+            std::vector<T> identity(len, Op::identity());
+
+            auto source = [&](int i) -> const T* {
+                const int y = begin - r + i;
+                return y >= 0 && y < height ? src + y * srcStride : identity.data();
+            };
+
+            for (int b = 0; b < padded; b += k) {
+                memcpy(&g[size_t(b) * len], source(b), len * sizeof(T));
+                for (int i = 1; i < k; i++) {
+                    Op::rows(&g[size_t(b + i - 1) * len], source(b + i), &g[size_t(b + i) * len], len);
+                }
+                memcpy(&h[size_t(b + k - 1) * len], source(b + k - 1), len * sizeof(T));
+                for (int i = k - 2; i >= 0; i--) {
+                    Op::rows(&h[size_t(b + i + 1) * len], source(b + i), &h[size_t(b + i) * len], len);
+                }
+            }
+
+            for (int y = begin; y < end; y++) {
+                const int i = y - begin;
+                Op::rows(&h[size_t(i) * len], &g[size_t(i + k - 1) * len], dst + y * dstStride, len);
+            }
+        });
+    }
+
+    // Same along each row of a Grayscale8 image
+    template<class Op>
+    static void horizontalPass(const QImage& src, QImage& dst, int k) {
+        const int width = src.width();
+        const int r = k / 2;
+        const int padded = (width + k - 1 + k - 1) / k * k;
+
+        const ImageRows dstRows(dst);
+        parallelBands(src.height(), [&](int begin, int end) {
+            std::vector<quint8> p(padded, Op::identity());
+            std::vector<quint8> g(padded);
+            std::vector<quint8> h(padded);
+
+            for (int y = begin; y < end; y++) {
+                memcpy(&p[r], src.constScanLine(y), width);
+
+                for (int b = 0; b < padded; b += k) {
+                    g[b] = p[b];
+                    for (int i = 1; i < k; i++) {
+                        g[b + i] = Op::op(g[b + i - 1], p[b + i]);
+                    }
+                    h[b + k - 1] = p[b + k - 1];
+                    for (int i = k - 2; i >= 0; i--) {
+                        h[b + i] = Op::op(h[b + i + 1], p[b + i]);
+                    }
+                }
+
+                quint8 *line = dstRows[y];
+                for (int x = 0; x < width; x++) {
+                    line[x] = Op::op(h[x], g[x + k - 1]);
+                }
+            }
+        });
+    }
+
+    template<class Op>
+    static QImage separable(const QImage& input, int w, int h) {
+        QImage temp = pooledImage(input.size(), QImage::Format_Grayscale8);
+        QImage res = pooledImage(input.size(), QImage::Format_Grayscale8);
+
+        horizontalPass<Op>(input, temp, qMax(1, w));
+        verticalPass<Op>(temp.constBits(), temp.bytesPerLine(), res.bits(), res.bytesPerLine(),
+                         input.height(), input.width(), qMax(1, h));
+        return res;
+    }
+
+
+    bool isBinary(const QImage& image) {
+        if (image.format() != QImage::Format_Grayscale8)
+            return false;
+
+        for (int y = 0; y < image.height(); y++) {
+            const quint8 *line = image.constScanLine(y);
+            for (int x = 0; x < image.width(); x++) {
+                if (line[x] != 0x00 && line[x] != 0xFF)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // pixels >= 128 are set, padding bits past the width are clear
+    BitImage packBits(const QImage& image) {
+        BitImage res;
+        res.width = image.width();
+        res.height = image.height();
+        res.words = (res.width + 63) / 64;
+        res.bits.assign(size_t(res.words) * res.height, 0);
+
+        parallelBands(res.height, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                const quint8 *line = image.constScanLine(y);
+                quint64 *row = res.row(y);
+                int x = 0;
+
+#ifdef __SSE2__
+                // the sign bit of each byte is exactly pixel >= 128
+                for (; x + 64 <= res.width; x += 64) {
+                    quint64 word = 0;
+                    for (int i = 0; i < 4; i++) {
+                        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x + 16 * i));
+                        word |= quint64(quint16(_mm_movemask_epi8(v))) << (16 * i);
+                    }
+                    row[x / 64] = word;
+                }
+#endif
+
+                for (; x < res.width; x++) {
+                    if (line[x] >= 0x80)
+                        row[x / 64] |= Q_UINT64_C(1) << (x % 64);
+                }
+            }
+        });
+
+        return res;
+    }
+
+    QImage unpackBits(const BitImage& image) {
+        QImage res = pooledImage(QSize(image.width, image.height), QImage::Format_Grayscale8);
+
+        const ImageRows resRows(res);
+        parallelBands(image.height, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                const quint64 *row = image.row(y);
+                quint8 *line = resRows[y];
+                for (int x = 0; x < image.width; x++) {
+                    line[x] = (row[x / 64] >> (x % 64)) & 1 ? 0xFF : 0x00;
+                }
+            }
+        });
+
+        return res;
+    }
+
+    // 64 bits of a row starting at bit pos, fill outside the row
+    static inline quint64 bitsAt(const quint64 *row, int words, qint64 pos, quint64 fill) {
+        const qint64 w = pos >> 6;
+        const int b = pos & 63;
+        const quint64 lo = w >= 0 && w < words ? row[w] : fill;
+        if (b == 0)
+            return lo;
+        const quint64 hi = w + 1 >= 0 && w + 1 < words ? row[w + 1] : fill;
+        return (lo >> b) | (hi << (64 - b));
+    }
+
+    // Window of k bits along each row by doubling: after step n every bit holds
+    // the op of the next 2^n bits, the window is assembled from the binary digits
+    // of k, so a row costs O(words * log k). Rows are first shifted right by the
+    // anchor into a buffer long enough that every window starts inside it.
+    template<class Op>
+    static void horizontalBits(const BitImage& src, BitImage& dst, int k) {
+        const int words = src.words;
+        const int extended = (src.width + k + 63) / 64;
+        const int r = k / 2;
+        const int tail = src.width % 64;
+        const quint64 tailMask = tail ? (Q_UINT64_C(1) << tail) - 1 : ~Q_UINT64_C(0);
+
+        parallelBands(src.height, [&](int begin, int end) {
+            std::vector<quint64> row(words), cur(extended), next(extended), acc(extended);
+
+            for (int y = begin; y < end; y++) {
+                memcpy(row.data(), src.row(y), words * sizeof(quint64));
+                // bits past the width act as pixels outside the image
+                row[words - 1] = (row[words - 1] & tailMask) | (Op::identity() & ~tailMask);
+                for (int w = 0; w < extended; w++) {
+                    cur[w] = bitsAt(row.data(), words, qint64(w) * 64 - r, Op::identity());
+                }
+                std::fill(acc.begin(), acc.end(), Op::identity());
+
+                int offset = 0;
+                int length = 1;
+                for (int rest = k; rest; ) {
+                    if (rest & 1) {
+                        for (int w = 0; w < words; w++) {
+                            acc[w] = Op::op(acc[w], bitsAt(cur.data(), extended, qint64(w) * 64 + offset, Op::identity()));
+                        }
+                        offset += length;
+                    }
+                    rest >>= 1;
+                    if (rest) {
+                        for (int w = 0; w < extended; w++) {
+                            next[w] = Op::op(cur[w], bitsAt(cur.data(), extended, qint64(w) * 64 + length, Op::identity()));
+                        }
+                        cur.swap(next);
+                        length *= 2;
+                    }
+                }
+
+                memcpy(dst.row(y), acc.data(), words * sizeof(quint64));
+            }
+        });
+    }
+
+    template<class Op>
+    static BitImage separable(const BitImage& input, int w, int h) {
+        BitImage temp = input;
+        BitImage res = input;
+
+        horizontalBits<Op>(input, temp, qMax(1, w));
+        verticalPass<Op>(temp.bits.data(), temp.words, res.bits.data(), res.words,
+                         input.height, input.words, qMax(1, h));
+        return res;
+    }
+
+    BitImage erode(const BitImage& input, int w, int h) {
+        return separable<AndOp>(input, w, h);
+    }
+
+    BitImage dilate(const BitImage& input, int w, int h) {
+        return separable<OrOp>(input, w, h);
+    }
+
+
+    QImage erode(const QImage& input, int w, int h) {
+        if (isBinary(input))
+            return unpackBits(erode(packBits(input), w, h));
+        return separable<MinOp>(input, w, h);
+    }
+
+    QImage dilate(const QImage& input, int w, int h) {
+        if (isBinary(input))
+            return unpackBits(dilate(packBits(input), w, h));
+        return separable<MaxOp>(input, w, h);
+    }
+
+    // removes bright specks smaller than the element
+    QImage opening(const QImage& input, int w, int h) {
+        if (isBinary(input))
+            return unpackBits(dilate(erode(packBits(input), w, h), w, h));
+        return dilate(erode(input, w, h), w, h);
+    }
+
+    // fills dark gaps smaller than the element
+    QImage closing(const QImage& input, int w, int h) {
+        if (isBinary(input))
+            return unpackBits(erode(dilate(packBits(input), w, h), w, h));
+        return erode(dilate(input, w, h), w, h);
+    }
+
+    QImage morphology(const QImage& input, MorphologyOperation operation, int w, int h) {
+        switch (operation) {
+        case MorphologyOperation::Erode:
+            return erode(input, w, h);
+        case MorphologyOperation::Dilate:
+            return dilate(input, w, h);
+        case MorphologyOperation::Open:
+            return opening(input, w, h);
+        case MorphologyOperation::Close:
+            return closing(input, w, h);
+        }
+        return input;
+    }
+}
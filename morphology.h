@@ -0,0 +1,41 @@
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include <QImage>
+#include <vector>
+
+namespace algorithms
+{
+    // Binary image packed 64 pixels per word, bit i of word w is pixel 64 * w + i
+    struct BitImage {
+        int width;
+        int height;
+        int words;      // per row
+        std::vector<quint64> bits;
+
+        BitImage() : width(0), height(0), words(0) {}
+
+        quint64* row(int y) { return bits.data() + size_t(y) * words; }
+        const quint64* row(int y) const { return bits.data() + size_t(y) * words; }
+    };
+
+    enum class MorphologyOperation { Erode, Dilate, Open, Close };
+
+    bool isBinary(const QImage&);
+    BitImage packBits(const QImage&);
+    QImage unpackBits(const BitImage&);
+
+    // Rectangular structuring element of w x h pixels centered on each pixel,
+    // lines are 1 x h or w x 1. Cost per pixel does not depend on the size
+    // (van Herk/Gil-Werman); 0/255 images are processed bit-packed.
+    QImage erode(const QImage&, int, int);
+    QImage dilate(const QImage&, int, int);
+    QImage opening(const QImage&, int, int);
+    QImage closing(const QImage&, int, int);
+    QImage morphology(const QImage&, MorphologyOperation, int, int);
+
+    BitImage erode(const BitImage&, int, int);
+    BitImage dilate(const BitImage&, int, int);
+}
+
+#endif // MORPHOLOGY_H
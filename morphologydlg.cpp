@@ -0,0 +1,41 @@
+#include "morphologydlg.h"
+#include "ui_morphologydlg.h"
+
+// combo items: square, horizontal line, vertical line
+enum { Square, HorizontalLine, VerticalLine };
+
+MorphologyDlg::MorphologyDlg(const QSize& element, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::MorphologyDlg)
+{
+    ui->setupUi(this);
+    this->setWindowFlags(this->windowFlags() & ~Qt::WindowContextHelpButtonHint);
+
+    if (element.height() == 1 && element.width() > 1) {
+        ui->shapeCombo->setCurrentIndex(HorizontalLine);
+    } else if (element.width() == 1 && element.height() > 1) {
+        ui->shapeCombo->setCurrentIndex(VerticalLine);
+    } else {
+        ui->shapeCombo->setCurrentIndex(Square);
+    }
+    ui->sizeSpinBox->setValue(qMax(element.width(), element.height()));
+}
+
+MorphologyDlg::~MorphologyDlg()
+{
+    delete ui;
+}
+
+// the element is centered on each pixel, so its sides are kept odd
+QSize MorphologyDlg::element() const
+{
+    const int size = ui->sizeSpinBox->value() | 1;
+    switch (ui->shapeCombo->currentIndex()) {
+    case HorizontalLine:
+        return QSize(size, 1);
+    case VerticalLine:
+        return QSize(1, size);
+    default:
+        return QSize(size, size);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef MORPHOLOGYDLG_H
+#define MORPHOLOGYDLG_H
+
+#include <QDialog>
+#include <QSize>
+
+namespace Ui {
+class MorphologyDlg;
+}
+
+class MorphologyDlg : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit MorphologyDlg(const QSize& element, QWidget *parent = 0);
+    ~MorphologyDlg();
+
+    QSize element() const;
+
+private:
+    Ui::MorphologyDlg *ui;
+};
+
+#endif // MORPHOLOGYDLG_H
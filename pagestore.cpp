@@ -0,0 +1,224 @@
+#include "pagestore.h"
+#include "parallel.h"
+#include <QtConcurrent>
+#include <cstring>
+
+// zlib at its fastest level, scans compress well and it ships with Qt
+static const int CompressionLevel = 1;
+
+QRect PageStore::Packed::tileRect(int index) const
+{
+    const int columns = this->columns();
+    return QRect((index % columns) * tileWidth, (index / columns) * tileHeight, tileWidth, tileHeight)
+            .intersected(QRect(QPoint(0, 0), size));
+}
+
+PageStore::PageStore(int prefetch) :
+    m_active(0), m_prefetch(prefetch)
+{
+}
+
+// running prefetches work on their own copy of the tiles and are dropped
+void PageStore::clear()
+{
+    m_pages.clear();
+    m_active = 0;
+}
+
+int PageStore::append(const QImage& image, const QString& name, const QImage& original)
+{
+    Page page;
+    page.name = name;
+    page.original = original;
+    page.image = image;
+    m_pages.append(page);
+
+    // the window wraps, so a new last page can push another one out of it
+    updateWindow();
+    return m_pages.size() - 1;
+}
+
+void PageStore::setActive(int index)
+{
+    if (index < 0 || index >= m_pages.size())
+        return;
+
+    m_active = index;
+    updateWindow();
+}
+
+// Pages entering the window start decompressing in the background, pages
+// leaving it drop their plain image
+void PageStore::updateWindow()
+{
+    for (int i = 0; i < m_pages.size(); i++) {
+        Page& page = m_pages[i];
+        if (!inWindow(i)) {
+            evict(page);
+        } else if (page.image.isNull() && !page.prefetching) {
+            page.prefetching = true;
+            page.prefetched = QtConcurrent::run(&PageStore::decompress, page.packed,
+                                                QRect(QPoint(0, 0), page.packed.size));
+        }
+    }
+}
+
+QString PageStore::name(int index) const
+{
+    return m_pages[index].name;
+}
+
+QImage PageStore::original(int index) const
+{
+    return m_pages[index].original;
+}
+
+QImage PageStore::image(int index)
+{
+    Page& page = m_pages[index];
+    if (!page.image.isNull())
+        return page.image;
+
+    QImage image;
+    if (page.prefetching) {
+        image = page.prefetched.result();
+        page.prefetching = false;
+        page.prefetched = QFuture<QImage>();
+    } else {
+        image = decompress(page.packed, QRect(QPoint(0, 0), page.packed.size));
+    }
+
+    // keep it only while the page is near the active one
+    if (inWindow(index))
+        page.image = image;
+    return image;
+}
+
+// A page kept or already decoded is cropped, otherwise only the tiles
+// intersecting rect are decompressed, even while a prefetch of the page runs
+QImage PageStore::region(int index, const QRect& rect)
+{
+    Page& page = m_pages[index];
+    if (!page.image.isNull() || (page.prefetching && page.prefetched.isFinished()))
+        return image(index).copy(rect);
+    return decompress(page.packed, rect.intersected(QRect(QPoint(0, 0), page.packed.size)));
+}
+
+PageStore::Usage PageStore::usage() const
+{
+    Usage usage = { 0, 0, 0 };
+    for (const auto& page : m_pages) {
+        const QImage& image = page.image;
+        if (!image.isNull()) {
+            usage.decompressedBytes += qint64(image.bytesPerLine()) * image.height();
+            usage.rawBytes += qint64(image.bytesPerLine()) * image.height();
+        } else {
+            // QImage rows are padded to 32 bits
+            const int depth = QImage::toPixelFormat(page.packed.format).bitsPerPixel();
+            const qint64 bytes = (qint64(page.packed.size.width()) * depth + 31) / 32 * 4 * page.packed.size.height();
+            usage.rawBytes += bytes;
+            // a prefetch holds the plain image from the time it starts
+            if (page.prefetching)
+                usage.decompressedBytes += bytes;
+        }
+
+        for (const auto& tile : page.packed.tiles) {
+            usage.compressedBytes += tile.size();
+        }
+    }
+    return usage;
+}
+
+bool PageStore::inWindow(int index) const
+{
+    // Next wraps around, so the window does too
+    const int n = m_pages.size();
+    const int ahead = (index - m_active + n) % n;
+    const int behind = (m_active - index + n) % n;
+    return qMin(ahead, behind) <= m_prefetch;
+}
+
+// pages in the store never change, so the tiles are only built once
+void PageStore::evict(Page& page)
+{
+    // a running decompression finishes on its own, its result is dropped
+    page.prefetching = false;
+    page.prefetched = QFuture<QImage>();
+    if (page.image.isNull())
+        return;
+
+    if (page.packed.tiles.isEmpty())
+        page.packed = compress(page.image);
+    page.image = QImage();
+}
+
+PageStore::Packed PageStore::compress(const QImage& image)
+{
+    Packed packed;
+    packed.size = image.size();
+    packed.format = image.format();
+    packed.colorTable = image.colorTable();
+    packed.tileWidth = image.depth() < 8 ? image.width() : TileSize;
+    packed.tileHeight = TileSize;
+
+    const int tiles = packed.columns() * ((image.height() + TileSize - 1) / TileSize);
+    packed.tiles.resize(tiles);
+
+    QVector<int> indices(tiles);
+    for (int i = 0; i < tiles; i++) {
+        indices[i] = i;
+    }
+
+    QtConcurrent::blockingMap(indices, [&](int index) {
+        const QRect rect = packed.tileRect(index);
+        const int bytes = (rect.width() * image.depth() + 7) / 8;
+        const int offset = rect.x() * image.depth() / 8;
+
+        QByteArray raw(bytes * rect.height(), Qt::Uninitialized);
+        for (int y = 0; y < rect.height(); y++) {
+            memcpy(raw.data() + y * bytes, image.constScanLine(rect.y() + y) + offset, bytes);
+        }
+        packed.tiles[index] = qCompress(raw, CompressionLevel);
+    });
+
+    return packed;
+}
+
+QImage PageStore::decompress(const Packed& packed, const QRect& region)
+{
+    if (region.isEmpty())
+        return QImage();
+
+    // pixels of sub-byte formats may not start on a byte, decompress full
+    // width rows and crop at the end
+    const int depth = QImage::toPixelFormat(packed.format).bitsPerPixel();
+    const QRect rect = depth < 8 ? QRect(0, region.y(), packed.size.width(), region.height()) : region;
+
+    QImage image(rect.size(), packed.format);
+    image.setColorTable(packed.colorTable);
+
+    QVector<int> indices;
+    for (int i = 0; i < packed.tiles.size(); i++) {
+        if (packed.tileRect(i).intersects(rect))
+            indices.append(i);
+    }
+
+    const algorithms::ImageRows rows(image);
+    QtConcurrent::blockingMap(indices, [&](int index) {
+        const QRect tile = packed.tileRect(index);
+        const QRect part = tile.intersected(rect);
+        const QByteArray raw = qUncompress(packed.tiles[index]);
+        const int bytes = (tile.width() * depth + 7) / 8;
+        const int srcOffset = (part.x() - tile.x()) * depth / 8;
+        const int dstOffset = (part.x() - rect.x()) * depth / 8;
+        const int length = (part.width() * depth + 7) / 8;
+
+        for (int y = part.top(); y <= part.bottom(); y++) {
+            memcpy(rows[y - rect.y()] + dstOffset, raw.constData() + (y - tile.y()) * bytes + srcOffset, length);
+        }
+    });
+
+    if (rect != region)
+        return image.copy(region.translated(-rect.topLeft()));
+    return image;
+}
@@ -0,0 +1,85 @@
+#ifndef PAGESTORE_H
+#define PAGESTORE_H
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QFuture>
+
+// Open pages kept in RAM. Pages away from the active one are held as
+// compressed tiles only; the active page and its neighbours within the
+// prefetch window stay decompressed, neighbours being decoded in the
+// background. A page outside the window is decompressed on demand, its
+// tiles in parallel; region() decompresses only the tiles a part of a page
+// needs and leaves the page compressed.
+class PageStore
+{
+public:
+    struct Usage {
+        qint64 decompressedBytes;   // pages held or being decoded as plain images
+        qint64 compressedBytes;     // compressed tiles
+        qint64 rawBytes;            // all pages as plain images
+    };
+
+    explicit PageStore(int prefetch = 1);
+
+    void clear();
+    int count() const { return m_pages.size(); }
+    bool isEmpty() const { return m_pages.isEmpty(); }
+    int active() const { return m_active; }
+
+    // original is the image a filter result was computed from, if any
+    int append(const QImage& image, const QString& name, const QImage& original = QImage());
+    void setActive(int index);
+
+    QString name(int index) const;
+    QImage original(int index) const;
+    QImage image(int index);
+    QImage region(int index, const QRect& rect);
+
+    Usage usage() const;
+
+private:
+    // tiles of TileSize pixels in row major order, formats below 8 bits
+    // per pixel are cut in full width bands so tiles start on a byte
+    struct Packed {
+        QSize size;
+        QImage::Format format;
+        QVector<QRgb> colorTable;
+        int tileWidth;
+        int tileHeight;
+        QVector<QByteArray> tiles;
+
+        Packed() : format(QImage::Format_Invalid), tileWidth(0), tileHeight(0) {}
+        int columns() const { return (size.width() + tileWidth - 1) / tileWidth; }
+        QRect tileRect(int index) const;
+    };
+
+    struct Page {
+        QString name;
+        QImage original;
+        QImage image;               // null while only compressed
+        bool prefetching;
+        QFuture<QImage> prefetched; // background decompression
+        Packed packed;              // empty until the page first leaves the window
+
+        Page() : prefetching(false) {}
+    };
+
+    static const int TileSize = 256;
+
+    static Packed compress(const QImage& image);
+    static QImage decompress(const Packed& packed, const QRect& region);
+
+    bool inWindow(int index) const;
+    void updateWindow();
+    void evict(Page& page);
+
+    QVector<Page> m_pages;
+    int m_active;
+    int m_prefetch;
+};
+
+#endif // PAGESTORE_H
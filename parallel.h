@@ -0,0 +1,46 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QImage>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+
+namespace algorithms
+{
+    // Split [0, count) into contiguous bands and run fn(begin, end) for every
+    // band on the global thread pool. Bands are at least minBand long.
+    template<class F>
+    void parallelBands(int count, F fn, int minBand = 16) {
+        if (count <= 0)
+            return;
+
+        int bands = qBound(1, count / qMax(1, minBand), QThread::idealThreadCount() * 4);
+        int step = (count + bands - 1) / bands;
+
+        QVector<int> starts;
+        for (int begin = 0; begin < count; begin += step) {
+            starts.append(begin);
+        }
+
+        QtConcurrent::blockingMap(starts, [&fn, step, count](int begin) {
+            fn(begin, qMin(begin + step, count));
+        });
+    }
+
+    // Rows of an image for bands to write to. QImage::scanLine() detaches on
+    // every call, which is not thread safe even for an unshared image, so the
+    // bits are taken once before the bands start.
+    class ImageRows
+    {
+    public:
+        explicit ImageRows(QImage& image) : m_bits(image.bits()), m_stride(image.bytesPerLine()) {}
+        uchar* operator[](int y) const { return m_bits + qptrdiff(y) * m_stride; }
+
+    private:
+        uchar *m_bits;
+        qptrdiff m_stride;
+    };
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,230 @@
+#include <QtWidgets>
+#include "pyramid.h"
+#include "algorithms.h"
+#include "morphology.h"
+#include "parallel.h"
+#include "bufferpool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace algorithms
+{
+    // finer levels are searched in tiles of this size around the coarse edges
+    static const int RefineTile = 128;
+    // coarse edges are widened by this many coarse pixels before refining
+    static const int FocusRadius = 2;
+
+    // sum of five rows with weights 1 4 6 4 1, at most 16 * 255 so it fits 16 bits
+    static void verticalTaps(const quint8 *r0, const quint8 *r1, const quint8 *r2,
+                             const quint8 *r3, const quint8 *r4, quint16 *out, int width) {
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 16 <= width; x += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x));
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r2 + x));
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r3 + x));
+            const __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r4 + x));
+
+            for (int half = 0; half < 2; half++) {
+                __m128i ae, bd, cc;
+                if (half == 0) {
+                    ae = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(e, zero));
+                    bd = _mm_add_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(d, zero));
+                    cc = _mm_unpacklo_epi8(c, zero);
+                } else {
+                    ae = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(e, zero));
+                    bd = _mm_add_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(d, zero));
+                    cc = _mm_unpackhi_epi8(c, zero);
+                }
+                // ae + 4 bd + 6 cc
+                __m128i sum = _mm_add_epi16(ae, _mm_slli_epi16(bd, 2));
+                sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(cc, 2), _mm_slli_epi16(cc, 1)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 8 * half), sum);
+            }
+        }
+#endif
+        for (; x < width; x++) {
+            out[x] = r0[x] + r4[x] + 4 * (r1[x] + r3[x]) + 6 * r2[x];
+        }
+    }
+
+#ifdef __SSE2__
+    // even and odd 16-bit lanes of two vectors, each as one vector of 8
+    static inline __m128i evenLanes(__m128i u, __m128i v) {
+        return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(u, 16), 16),
+                               _mm_srai_epi32(_mm_slli_epi32(v, 16), 16));
+    }
+
+    static inline __m128i oddLanes(__m128i u, __m128i v) {
+        return _mm_packs_epi32(_mm_srai_epi32(u, 16), _mm_srai_epi32(v, 16));
+    }
+
+    static inline __m128i load(const quint16 *p) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    }
+#endif
+
+    // Taps 1 4 6 4 1 around every second column of a row of vertical sums.
+    // sums has two replicated columns on each side, sums[2] is column 0.
+    static void horizontalTaps(const quint16 *sums, quint8 *out, int outWidth) {
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i round = _mm_set1_epi16(128);
+        // a block reads 20 values from sums + 2x, the row has slack for the last one
+        for (; x + 8 <= outWidth; x += 8) {
+            const quint16 *p = sums + 2 * x;
+            const __m128i a = load(p), b = load(p + 8);
+            const __m128i c = load(p + 2), d = load(p + 10);
+            const __m128i e = load(p + 4), f = load(p + 12);
+
+            // out = E[-1] + 4 O[-1] + 6 E[0] + 4 O[0] + E[1], up to 65280 so
+            // the 16-bit adds are taken as unsigned
+            const __m128i e0 = evenLanes(c, d);
+            __m128i sum = _mm_add_epi16(evenLanes(a, b), evenLanes(e, f));
+            sum = _mm_add_epi16(sum, _mm_slli_epi16(_mm_add_epi16(oddLanes(a, b), oddLanes(c, d)), 2));
+            sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(e0, 2), _mm_slli_epi16(e0, 1)));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 8);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(sum, sum));
+        }
+#endif
+        for (; x < outWidth; x++) {
+            const quint16 *p = sums + 2 * x;
+            out[x] = (p[0] + 4 * p[1] + 6 * p[2] + 4 * p[3] + p[4] + 128) >> 8;
+        }
+    }
+
+    QImage pyrDown(const QImage& input) {
+        const QImage image = input.format() == QImage::Format_Grayscale8
+                ? input : input.convertToFormat(QImage::Format_Grayscale8);
+        const int width = image.width();
+        const int height = image.height();
+        QImage out = pooledImage(QSize((width + 1) / 2, (height + 1) / 2), QImage::Format_Grayscale8);
+        if (image.isNull())
+            return out;
+
+        const ImageRows outRows(out);
+        parallelBands(out.height(), [&](int begin, int end) {
+            // two replicated columns on each side, and slack for the vector loads
+            PooledArray<quint16> sums(width + 4 + 16);
+
+            for (int y = begin; y < end; y++) {
+                const quint8 *rows[5];
+                for (int j = 0; j < 5; j++) {
+                    rows[j] = image.constScanLine(qBound(0, 2 * y + j - 2, height - 1));
+                }
+                verticalTaps(rows[0], rows[1], rows[2], rows[3], rows[4], sums.data() + 2, width);
+                sums[0] = sums[1] = sums[2];
+                sums[width + 2] = sums[width + 3] = sums[width + 1];
+
+                horizontalTaps(sums.data(), outRows[y], out.width());
+            }
+        });
+
+        return out;
+    }
+
+    QVector<QImage> gaussianPyramid(const QImage& image, int levels, int minSide) {
+        QVector<QImage> pyramid;
+        pyramid.append(image.format() == QImage::Format_Grayscale8
+                       ? image : image.convertToFormat(QImage::Format_Grayscale8));
+
+        while (pyramid.size() < levels) {
+            const QImage& last = pyramid.last();
+            if ((qMin(last.width(), last.height()) + 1) / 2 < minSide)
+                break;
+            pyramid.append(pyrDown(last));
+        }
+        return pyramid;
+    }
+
+    // Canny without hysteresis: the fixed 5x5 Gaussian, Sobel gradients and
+    // non-maximum suppression. Every output pixel depends on the input within
+    // SuppressionHalo pixels only.
+    static const int SuppressionHalo = 4;
+
+    static QImage suppressedGradient(const QImage& image) {
+        QImage res = smooth(image, Smoothing::Gaussian, 1);
+        const QImage gx = convolution(sobelx, res);
+        const QImage gy = convolution(sobely, res);
+        magnitude(res, gx, gy);
+        nonMaximumSuppression(res, gx, gy);
+        return res;
+    }
+
+    // Edges of level inside the neighbourhood of the edges of the level above
+    static QImage refine(const QImage& level, const QImage& coarseEdges, double tmin, double tmax) {
+        QImage nms = pooledImage(level.size(), QImage::Format_Grayscale8);
+        nms.fill(0x00);
+
+        const BitImage focus = dilate(packBits(coarseEdges), 2 * FocusRadius + 1, 2 * FocusRadius + 1);
+        auto inFocus = [&focus](int x, int y) {
+            const int cx = qMin(x / 2, focus.width - 1);
+            const int cy = qMin(y / 2, focus.height - 1);
+            return (focus.row(cy)[cx >> 6] >> (cx & 63)) & 1;
+        };
+
+        // runs of tiles with any focus pixel along each tile row, tested on
+        // the coarse grid; a run is filtered at once so the halo is paid once
+        QVector<QRect> runs;
+        for (int ty = 0; ty < level.height(); ty += RefineTile) {
+            QRect run;
+            for (int tx = 0; tx < level.width(); tx += RefineTile) {
+                const QRect tile = QRect(tx, ty, RefineTile, RefineTile).intersected(level.rect());
+                bool found = false;
+                for (int y = tile.top(); y <= tile.bottom() && !found; y += 2) {
+                    for (int x = tile.left(); x <= tile.right() && !found; x += 2) {
+                        found = inFocus(x, y);
+                    }
+                }
+                if (found) {
+                    run = run.united(tile);
+                } else if (!run.isEmpty()) {
+                    runs.append(run);
+                    run = QRect();
+                }
+            }
+            if (!run.isEmpty())
+                runs.append(run);
+        }
+
+        // the local stages are exact per run, and only keep pixels in focus
+        const ImageRows nmsRows(nms);
+        QtConcurrent::blockingMap(runs, [&](const QRect& tile) {
+            const QRect padded = tile.adjusted(-SuppressionHalo, -SuppressionHalo,
+                                               SuppressionHalo, SuppressionHalo).intersected(level.rect());
+            const QImage result = suppressedGradient(pooledCopy(level, padded));
+
+            for (int y = tile.top(); y <= tile.bottom(); y++) {
+                const quint8 *src = result.constScanLine(y - padded.top()) - padded.left();
+                quint8 *dst = nmsRows[y];
+                for (int x = tile.left(); x <= tile.right(); x++) {
+                    if (inFocus(x, y))
+                        dst[x] = src[x];
+                }
+            }
+        });
+
+        // hysteresis follows edges any distance, so it runs once on the whole
+        // level; it can't leave the focus since everything else is zero
+        return hysteresis(nms, tmin, tmax);
+    }
+
+    QImage multiScaleCanny(const QImage& image, int levels, double tmin, double tmax, QVector<QImage>* scales) {
+        const QVector<QImage> pyramid = gaussianPyramid(image, qMax(1, levels));
+
+        QVector<QImage> maps(pyramid.size());
+        maps.last() = hysteresis(suppressedGradient(pyramid.last()), tmin, tmax);
+        for (int l = pyramid.size() - 2; l >= 0; l--) {
+            maps[l] = refine(pyramid[l], maps[l + 1], tmin, tmax);
+        }
+
+        if (scales)
+            *scales = maps;
+        return maps.first();
+    }
+}
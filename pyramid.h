@@ -0,0 +1,31 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <QImage>
+#include <QVector>
+
+namespace algorithms
+{
+    // Half size image blurred with the 5-tap binomial [1 4 6 4 1] / 16 in both
+    // directions, borders replicated. Grayscale8 is reduced in place of
+    // a convolution, vectorized with SSE2 and run in parallel row bands;
+    // other formats are converted to Grayscale8 first.
+    QImage pyrDown(const QImage&);
+
+    // Gaussian pyramid, [0] is the (grayscale) input and every next level is
+    // pyrDown of the previous one. Stops early once a side would get below minSide.
+    QVector<QImage> gaussianPyramid(const QImage&, int, int = 32);
+
+    // Coarse to fine Canny (edge focusing). Canny with its fixed 5x5 Gaussian
+    // runs on the whole coarsest level, where that covers 2^(levels-1) times
+    // as many full resolution pixels. On every finer level blur, gradients and
+    // suppression are only computed in tiles around the edges found on the
+    // level above, keeping pixels within a couple of pixels of them; hysteresis
+    // then runs once on the whole level. The result does not depend on the
+    // tiling. It is the finest level: the coarse structures located at full
+    // resolution. The per-scale maps, [0] full resolution, are stored in
+    // scales when given.
+    QImage multiScaleCanny(const QImage&, int, double, double, QVector<QImage>* = 0);
+}
+
+#endif // PYRAMID_H
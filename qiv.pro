@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# The viewer and its tests in one build: "make" builds both,
+# "make check" runs tst_algorithms.
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = app tests
+app.file = imageviewer.pro
+tests.file = tests/tests.pro
+
+# imageviewer.pro has a check target of its own that builds and runs the
+# tests, only recurse into them once
+check.CONFIG = recursive
+check.recurse = tests
+QMAKE_EXTRA_TARGETS += check
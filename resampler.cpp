@@ -0,0 +1,336 @@
+#include <QtWidgets>
+#include <vector>
+#include "resampler.h"
+#include "parallel.h"
+#include "bufferpool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace algorithms
+{
+    // weights are 2.14 fixed point
+    static const int WeightBits = 14;
+    static const int WeightOne = 1 << WeightBits;
+
+    // Contributions of source pixels to every output pixel along one axis
+    struct Contributions {
+        int taps;                   // max taps per output pixel, padded with zero weights
+        std::vector<int> first;     // first source index per output pixel
+        std::vector<qint16> weights; // taps weights per output pixel
+    };
+
+    static double boxKernel(double x) {
+        return x > -0.5 && x <= 0.5 ? 1.0 : 0.0;
+    }
+
+    // Catmull-Rom (a = -0.5)
+    static double bicubicKernel(double x) {
+        const double a = -0.5;
+        x = std::fabs(x);
+        if (x < 1)
+            return ((a + 2) * x - (a + 3)) * x * x + 1;
+        if (x < 2)
+            return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a;
+        return 0;
+    }
+
+    static double sinc(double x) {
+        if (x == 0)
+            return 1;
+        x *= M_PI;
+        return std::sin(x) / x;
+    }
+
+    static double lanczos3Kernel(double x) {
+        return x > -3 && x < 3 ? sinc(x) * sinc(x / 3) : 0;
+    }
+
+    static Contributions computeContributions(int in, int out, ResampleFilter filter) {
+        double (*kernel)(double) = lanczos3Kernel;
+        double support = 3;
+        if (filter == ResampleFilter::Box) {
+            kernel = boxKernel;
+            support = 0.5;
+        } else if (filter == ResampleFilter::Bicubic) {
+            kernel = bicubicKernel;
+            support = 2;
+        }
+
+        // when shrinking the kernel is stretched to cover all source pixels
+        const double scale = double(out) / in;
+        const double stretch = qMax(1.0, 1 / scale);
+        support *= stretch;
+
+        Contributions c;
+        c.taps = qMin(in, static_cast<int>(std::ceil(support)) * 2 + 1);
+        c.first.resize(out);
+        c.weights.assign(size_t(out) * c.taps, 0);
+
+        std::vector<double> w(c.taps);
+        for (int i = 0; i < out; i++) {
+            const double center = (i + 0.5) / scale;
+            int begin = qMax(0, static_cast<int>(std::floor(center - support)));
+            int end = qMin(in, static_cast<int>(std::ceil(center + support)));
+            if (end - begin > c.taps)
+                end = begin + c.taps;
+
+            double total = 0;
+            for (int j = begin; j < end; j++) {
+                w[j - begin] = kernel((j + 0.5 - center) / stretch);
+                total += w[j - begin];
+            }
+
+            // keep all taps inside the source, so padded taps can be read safely
+            const int first = qMin(begin, in - c.taps);
+
+            // normalize, then push the rounding error into the center tap
+            qint16 *dst = &c.weights[size_t(i) * c.taps] + (begin - first);
+            int sum = 0;
+            int center_tap = 0;
+            for (int j = 0; j < end - begin; j++) {
+                dst[j] = static_cast<qint16>(qRound(w[j] / (total != 0 ? total : 1) * WeightOne));
+                sum += dst[j];
+                if (dst[j] > dst[center_tap])
+                    center_tap = j;
+            }
+            dst[center_tap] += WeightOne - sum;
+            c.first[i] = first;
+        }
+
+        return c;
+    }
+
+    static inline quint8 clampFixed(int sum) {
+        return static_cast<quint8>(qBound(0, (sum + (1 << (WeightBits - 1))) >> WeightBits, 0xFF));
+    }
+
+    static void horizontalPass(const quint8 *src, quint8 *dst, int width, int channels,
+                               const Contributions& c) {
+        for (int x = 0; x < width; x++) {
+            const quint8 *pixel = src + c.first[x] * channels;
+            const qint16 *w = &c.weights[size_t(x) * c.taps];
+
+#ifdef __SSE2__
+            if (channels == 4) {
+                // two taps per step: [c0 c0' c1 c1' ...] x [w w' w w' ...]
+                const __m128i zero = _mm_setzero_si128();
+                __m128i acc = _mm_setzero_si128();
+                int k = 0;
+                for (; k + 2 <= c.taps; k += 2) {
+                    __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixel + k * 4)), zero);
+                    p = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+                    const __m128i ww = _mm_set1_epi32((quint16)w[k] | (int(w[k + 1]) << 16));
+                    acc = _mm_add_epi32(acc, _mm_madd_epi16(p, ww));
+                }
+                for (; k < c.taps; k++) {
+                    __m128i p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*reinterpret_cast<const int*>(pixel + k * 4)), zero), zero);
+                    acc = _mm_add_epi32(acc, _mm_madd_epi16(p, _mm_set1_epi32((quint16)w[k])));
+                }
+                acc = _mm_srai_epi32(_mm_add_epi32(acc, _mm_set1_epi32(1 << (WeightBits - 1))), WeightBits);
+                acc = _mm_packs_epi32(acc, acc);
+                *reinterpret_cast<int*>(dst + x * 4) = _mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+                continue;
+            }
+#endif
+
+            for (int ch = 0; ch < channels; ch++) {
+                int sum = 0;
+                for (int k = 0; k < c.taps; k++) {
+                    sum += w[k] * pixel[k * channels + ch];
+                }
+                dst[x * channels + ch] = clampFixed(sum);
+            }
+        }
+    }
+
+    static void verticalPass(const quint8 * const *rows, const qint16 *w, int taps, quint8 *dst, int bytes) {
+        int x = 0;
+
+#ifdef __SSE2__
+        // eight bytes per step, two source rows per madd
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(1 << (WeightBits - 1));
+        for (; x + 8 <= bytes; x += 8) {
+            __m128i lo = round;
+            __m128i hi = round;
+            for (int k = 0; k < taps; k += 2) {
+                const __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[k] + x)), zero);
+                __m128i b = zero;
+                int wb = 0;
+                if (k + 1 < taps) {
+                    b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[k + 1] + x)), zero);
+                    wb = w[k + 1];
+                }
+                const __m128i ww = _mm_set1_epi32((quint16)w[k] | (wb << 16));
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), ww));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), ww));
+            }
+            lo = _mm_srai_epi32(lo, WeightBits);
+            hi = _mm_srai_epi32(hi, WeightBits);
+            const __m128i packed = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(packed, packed));
+        }
+#endif
+
+        for (; x < bytes; x++) {
+            int sum = 0;
+            for (int k = 0; k < taps; k++) {
+                sum += w[k] * rows[k][x];
+            }
+            dst[x] = clampFixed(sum);
+        }
+    }
+
+    QImage resample(const QImage& input, const QSize& size, ResampleFilter filter) {
+        if (input.isNull() || size.isEmpty())
+            return QImage();
+        return resampleRows(input, 0, input.height(), size, 0, size.height(), filter);
+    }
+
+    QImage resampleRows(const QImage& input, int inputTop, int sourceHeight, const QSize& size,
+                        int begin, int end, ResampleFilter filter) {
+        if (input.isNull() || size.isEmpty() || sourceHeight <= 0 || end <= begin)
+            return QImage();
+
+        QImage image = input;
+        if (image.format() != QImage::Format_Grayscale8 && image.depth() != 32) {
+            image = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                                  : QImage::Format_RGB32);
+        }
+        // unpremultiplied colour would bleed from transparent pixels
+        if (image.format() == QImage::Format_ARGB32) {
+            image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        }
+
+        if (filter == ResampleFilter::Auto) {
+            const double scale = qMin(double(size.width()) / image.width(), double(size.height()) / sourceHeight);
+            if (scale < 0.125)
+                filter = ResampleFilter::Box;
+            else if (scale < 1)
+                filter = ResampleFilter::Lanczos3;
+            else
+                filter = ResampleFilter::Bicubic;
+        }
+
+        // the vertical weights are those of the whole source, so separately
+        // rendered row ranges line up exactly
+        const int channels = image.depth() / 8;
+        const Contributions horizontal = computeContributions(image.width(), size.width(), filter);
+        const Contributions vertical = computeContributions(sourceHeight, size.height(), filter);
+        QImage res = pooledImage(QSize(size.width(), end - begin), image.format());
+
+        // source rows missing from input are replaced by the nearest one it has
+        auto sourceRow = [&](int y) {
+            return image.constScanLine(qBound(0, y - inputTop, image.height() - 1));
+        };
+
+        const ImageRows resRows(res);
+        parallelBands(end - begin, [&](int bandBegin, int bandEnd) {
+            // horizontally resampled source rows needed by this band
+            const int first = vertical.first[begin + bandBegin];
+            const int last = qMin(sourceHeight, vertical.first[begin + bandEnd - 1] + vertical.taps);
+            const int bytes = size.width() * channels;
+            std::vector<quint8> temp(size_t(last - first) * bytes);
+            for (int y = first; y < last; y++) {
+                horizontalPass(sourceRow(y), &temp[size_t(y - first) * bytes],
+                               size.width(), channels, horizontal);
+            }
+
+            std::vector<const quint8*> rows(vertical.taps);
+            for (int y = bandBegin; y < bandEnd; y++) {
+                const int top = vertical.first[begin + y];
+                for (int k = 0; k < vertical.taps; k++) {
+                    // padded taps have zero weight, any valid row will do
+                    rows[k] = &temp[size_t(qMin(top + k, last - 1) - first) * bytes];
+                }
+                verticalPass(rows.data(), &vertical.weights[size_t(begin + y) * vertical.taps], vertical.taps,
+                             resRows[y], bytes);
+            }
+        });
+
+        if (input.format() == QImage::Format_ARGB32)
+            return res.convertToFormat(QImage::Format_ARGB32);
+        return res;
+    }
+
+    QImage rotate(const QImage& input, double degrees, QRgb fill) {
+        if (input.isNull())
+            return QImage();
+
+        QImage image = input;
+        if (image.format() != QImage::Format_Grayscale8 && image.depth() != 32) {
+            image = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                                  : QImage::Format_RGB32);
+        }
+        if (image.format() == QImage::Format_ARGB32) {
+            image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        }
+
+        const int width = image.width();
+        const int height = image.height();
+        const int channels = image.depth() / 8;
+
+        // fill pixel in the memory layout of the image
+        quint8 background[4];
+        if (channels == 1) {
+            background[0] = qGray(fill);
+        } else {
+            const QRgb premultiplied = qPremultiply(fill);
+            memcpy(background, &premultiplied, 4);
+        }
+
+        const double angle = qDegreesToRadians(degrees);
+        const double c = std::cos(angle);
+        const double s = std::sin(angle);
+        const double cx = width / 2.0;
+        const double cy = height / 2.0;
+        const qint64 one = 1 << 16;
+        // inverse mapping, one step in x moves the source position by (c, -s)
+        const qint64 stepX = qRound64(c * one);
+        const qint64 stepY = qRound64(-s * one);
+
+        QImage res = pooledImage(image.size(), image.format());
+
+        const ImageRows resRows(res);
+        parallelBands(height, [&](int begin, int end) {
+            auto pixel = [&](int x, int y) -> const quint8* {
+                if (x < 0 || y < 0 || x >= width || y >= height)
+                    return background;
+                return image.constScanLine(y) + x * channels;
+            };
+
+            for (int y = begin; y < end; y++) {
+                const double dx = 0.5 - cx;
+                const double dy = y + 0.5 - cy;
+                // source position of the first pixel, minus half a pixel for pixel centres
+                qint64 sx = qRound64((cx + dx * c + dy * s - 0.5) * one);
+                qint64 sy = qRound64((cy - dx * s + dy * c - 0.5) * one);
+                quint8 *dst = resRows[y];
+
+                for (int x = 0; x < width; x++, sx += stepX, sy += stepY, dst += channels) {
+                    const int x0 = int(sx >> 16);
+                    const int y0 = int(sy >> 16);
+                    const int fx = int(sx >> 8) & 0xFF;
+                    const int fy = int(sy >> 8) & 0xFF;
+
+                    const quint8 *p00 = pixel(x0, y0);
+                    const quint8 *p01 = pixel(x0 + 1, y0);
+                    const quint8 *p10 = pixel(x0, y0 + 1);
+                    const quint8 *p11 = pixel(x0 + 1, y0 + 1);
+
+                    for (int k = 0; k < channels; k++) {
+                        const int top = p00[k] * (256 - fx) + p01[k] * fx;
+                        const int bottom = p10[k] * (256 - fx) + p11[k] * fx;
+                        dst[k] = (top * (256 - fy) + bottom * fy + (1 << 15)) >> 16;
+                    }
+                }
+            }
+        });
+
+        if (input.format() == QImage::Format_ARGB32)
+            return res.convertToFormat(QImage::Format_ARGB32);
+        return res;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <QImage>
+#include <QSize>
+
+namespace algorithms
+{
+    enum class ResampleFilter {
+        Auto,       // box for extreme downscale, Lanczos3 otherwise, bicubic to enlarge
+        Box,
+        Bicubic,
+        Lanczos3
+    };
+
+    // Separable resampling with precomputed fixed point weights: a horizontal
+    // and a vertical pass, run in parallel row bands. Grayscale8 and 32-bit
+    // images are processed as they are, other formats are converted to 32 bit.
+    QImage resample(const QImage&, const QSize&, ResampleFilter = ResampleFilter::Auto);
+
+    // Output rows [begin, end) of resampling a source of sourceHeight rows to
+    // size, when only the source rows from inputTop on are at hand in the image.
+    // Bands rendered this way join without seams if each one has the rows
+    // within the filter support.
+    QImage resampleRows(const QImage&, int inputTop, int sourceHeight, const QSize&,
+                        int begin, int end, ResampleFilter = ResampleFilter::Auto);
+
+    // Rotation about the centre by degrees clockwise, keeping the image size.
+    // Bilinear with 16.16 fixed point source positions, in parallel row bands;
+    // pixels mapped from outside the source get the fill colour.
+    QImage rotate(const QImage&, double, QRgb = 0xFFFFFFFF);
+}
+
+#endif // RESAMPLER_H
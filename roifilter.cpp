@@ -0,0 +1,92 @@
+#include "roifilter.h"
+#include "bufferpool.h"
+#include <cstring>
+
+// Grayscale8, RGB32 and ARGB32 are kept, any other format is committed as
+// 32-bit QRgb
+static QImage::Format tileFormat(QImage::Format format, bool alpha)
+{
+    if (format == QImage::Format_Grayscale8 || format == QImage::Format_RGB32
+            || format == QImage::Format_ARGB32)
+        return format;
+    return alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+}
+
+RoiFilterJob::RoiFilterJob(const QImage& source, Filter filter, int halo,
+                           QImage::Format outFormat, int tileSize) :
+    m_source(source), m_filter(filter), m_halo(halo),
+    m_outFormat(tileFormat(outFormat, source.hasAlphaChannel())), m_targetFormat(outFormat)
+{
+    for (int y = 0; y < source.height(); y += tileSize) {
+        for (int x = 0; x < source.width(); x += tileSize) {
+            m_pending.append(QRect(x, y, tileSize, tileSize).intersected(source.rect()));
+        }
+    }
+}
+
+QRect RoiFilterJob::takeRegion(const QRect& region)
+{
+    QRect bounds;
+    for (int i = m_pending.size() - 1; i >= 0; i--) {
+        if (m_pending[i].intersects(region)) {
+            bounds = bounds.united(m_pending[i]);
+            m_pending.remove(i);
+        }
+    }
+
+    // the bounding rect may cover tiles that were not touched by region
+    for (int i = m_pending.size() - 1; i >= 0; i--) {
+        if (bounds.contains(m_pending[i])) {
+            m_pending.remove(i);
+        }
+    }
+
+    return bounds;
+}
+
+QRect RoiFilterJob::takeNextTile(const QRect& visible)
+{
+    if (m_pending.isEmpty())
+        return QRect();
+
+    // tiles in view first, then the ones closest to the view centre
+    int best = 0;
+    qint64 bestDistance = -1;
+    for (int i = 0; i < m_pending.size(); i++) {
+        qint64 distance = 0;
+        if (!m_pending[i].intersects(visible)) {
+            distance = (m_pending[i].center() - visible.center()).manhattanLength() + 1;
+        }
+        if (bestDistance < 0 || distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+        }
+        if (distance == 0)
+            break;
+    }
+
+    QRect tile = m_pending[best];
+    m_pending.remove(best);
+    return tile;
+}
+
+QImage RoiFilterJob::filterRegion(const QRect& rect) const
+{
+    QRect padded = rect.adjusted(-m_halo, -m_halo, m_halo, m_halo).intersected(m_source.rect());
+    // filters that depend on the position in the image find it in the offset
+    QImage tile = algorithms::pooledCopy(m_source, padded);
+    tile.setOffset(padded.topLeft());
+    QImage result = m_filter(tile).convertToFormat(m_outFormat);
+    return algorithms::pooledCopy(result, rect.translated(-padded.topLeft()));
+}
+
+void RoiFilterJob::commitRegion(QImage& target, const QRect& rect, const QImage& filtered)
+{
+    Q_ASSERT(target.depth() >= 8 && target.format() == filtered.format());
+    const int bytes = rect.width() * target.depth() / 8;
+    const int offset = rect.x() * target.depth() / 8;
+
+    for (int y = 0; y < rect.height(); y++) {
+        memcpy(target.scanLine(rect.y() + y) + offset, filtered.constScanLine(y), bytes);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef ROIFILTER_H
+#define ROIFILTER_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+#include <functional>
+
+// Runs a neighbourhood filter over an image tile by tile.
+// Every tile is filtered on a copy padded by the kernel halo, so tiles can be
+// processed in any order (visible ones first) and on any thread.
+class RoiFilterJob
+{
+public:
+    typedef std::function<QImage(const QImage&)> Filter;
+
+    RoiFilterJob(const QImage& source, Filter filter, int halo,
+                 QImage::Format outFormat, int tileSize = 512);
+
+    // Tiles are filtered into and committed in one byte per channel, so they
+    // start on a byte and share no colour table; the finished image is
+    // converted to the target format once.
+    QImage::Format outputFormat() const { return m_outFormat; }
+    QImage::Format targetFormat() const { return m_targetFormat; }
+    bool isDone() const { return m_pending.isEmpty(); }
+    int pendingTiles() const { return m_pending.size(); }
+
+    // Bounding rect of all pending tiles touching region, removed from the queue
+    QRect takeRegion(const QRect& region);
+    // Pending tile with the highest priority for the given visible region
+    QRect takeNextTile(const QRect& visible);
+
+    // Thread safe: only reads the source image
+    QImage filterRegion(const QRect& rect) const;
+    static void commitRegion(QImage& target, const QRect& rect, const QImage& filtered);
+
+private:
+    QImage m_source;
+    Filter m_filter;
+    int m_halo;
+    QImage::Format m_outFormat;
+    QImage::Format m_targetFormat;
+    QVector<QRect> m_pending;
+};
+
+#endif // ROIFILTER_H
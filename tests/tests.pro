@@ -0,0 +1,35 @@
+#-------------------------------------------------
+#
+# Regression and throughput tests of the image algorithms.
+# Run with "make check" here, or from the build of imageviewer.pro or
+# qiv.pro; see tst_algorithms.cpp for recording baselines.
+#
+#-------------------------------------------------
+
+QT       += core gui testlib
+QT       += concurrent
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = tst_algorithms
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+DEFINES += BASELINE_DIR=\\\"$$PWD/baselines\\\" \
+    SAMPLE_DIR=\\\"$$PWD/data\\\"
+
+SOURCES += tst_algorithms.cpp \
+    ../algorithms.cpp \
+    ../roifilter.cpp \
+    ../cannypipeline.cpp \
+    ../integralimage.cpp \
+    ../morphology.cpp \
+    ../denoise.cpp \
+    ../pyramid.cpp \
+    ../tone.cpp \
+    ../bufferpool.cpp \
+    ../resampler.cpp \
+    ../pagestore.cpp \
+    ../deskew.cpp
@@ -0,0 +1,1060 @@
+#include <QtTest>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "algorithms.h"
+#include "kernels.h"
+#include "cannypipeline.h"
+#include "integralimage.h"
+#include "morphology.h"
+#include "denoise.h"
+#include "resampler.h"
+#include "pyramid.h"
+#include "tone.h"
+#include "roifilter.h"
+#include "pagestore.h"
+#include "deskew.h"
+
+// Regression tests for the image algorithms.
+//
+// The optimized paths (SSE2, parallel bands, tiles, fixed point, bit-packed,
+// constant time) are compared with plain scalar implementations written
+// here, within the tolerance stated for each. Golden hashes of the outputs
+// over a corpus of synthetic images, plus any image put in tests/data, catch
+// changes of behaviour; throughput is compared with a stored baseline.
+//
+// Baselines live in tests/baselines. golden.txt is kept in the repository
+// and only recorded again when a change of output is intended:
+//     QIV_RECORD_GOLDEN=1 ./tst_algorithms
+// throughput.txt is recorded per machine and not committed:
+//     QIV_RECORD=1 ./tst_algorithms
+// QIV_PERF_TOLERANCE is the allowed throughput loss (default 0.25 = 25%),
+// QIV_SKIP_PERF=1 skips the throughput gate on noisy machines.
+
+using namespace algorithms;
+
+namespace
+{
+    // fixed point weights may round a sum the other way, and floating point
+    // sums may be contracted differently by the compiler
+    const int ExactTolerance = 0;
+    const int RoundingTolerance = 1;
+
+    // share of the pixels of an edge map that may differ when hysteresis runs
+    // on tiles, it cannot follow an edge out of a padded tile; about 0.4% on
+    // the test pages
+    const double CannyTileShare = 0.01;
+
+    // refining step of detectSkew in degrees, with room for the rounding of
+    // the candidate angles
+    const double SkewStep = 0.02 + 1e-9;
+
+    const double DefaultPerfTolerance = 0.25;
+
+    // deterministic on every platform, unlike rand()
+    struct Random {
+        quint32 state;
+        explicit Random(quint32 seed) : state(seed) {}
+        int next(int range) {
+            state = state * 1664525u + 1013904223u;
+            return int((state >> 8) % quint32(range));
+        }
+    };
+
+    QImage noise(int width, int height, QImage::Format format, quint32 seed) {
+        QImage image(width, height, format);
+        Random random(seed);
+        for (int y = 0; y < height; y++) {
+            quint8 *line = image.scanLine(y);
+            for (int x = 0; x < (width * image.depth() + 7) / 8; x++) {
+                line[x] = random.next(256);
+            }
+        }
+        return image;
+    }
+
+    // noise through a palette that is neither gray nor the identity
+    QImage indexedNoise(int width, int height, quint32 seed) {
+        QImage image = noise(width, height, QImage::Format_Indexed8, seed);
+        QVector<QRgb> table;
+        for (int i = 0; i < 256; i++) {
+            table.append(qRgb(i, 255 - i, i / 2));
+        }
+        image.setColorTable(table);
+        return image;
+    }
+
+    // 1-bit noise with a table that is not black and white
+    QImage monoNoise(int width, int height, quint32 seed) {
+        QImage image = noise(width, height, QImage::Format_Mono, seed);
+        image.setColorTable(QVector<QRgb>() << qRgb(255, 255, 255) << qRgb(0, 0, 80));
+        return image;
+    }
+
+    // scanned page: paper with noise, a frame, lines of words
+    QImage page(int width, int height, quint32 seed) {
+        QImage image(width, height, QImage::Format_Grayscale8);
+        Random random(seed);
+        for (int y = 0; y < height; y++) {
+            quint8 *line = image.scanLine(y);
+            for (int x = 0; x < width; x++) {
+                line[x] = 218 + random.next(25);
+            }
+        }
+
+        const int margin = width / 10;
+        for (int y = margin; y < height - margin; y++) {
+            quint8 *line = image.scanLine(y);
+            for (int x = margin; x < width - margin; x++) {
+                const bool frame = x < margin + 3 || x >= width - margin - 3
+                        || y < margin + 3 || y >= height - margin - 3;
+                const bool text = (y - margin) % 14 >= 6 && (y - margin) % 14 < 12
+                        && ((x - margin) / 7 + (y - margin) / 14 * 5) % 9 != 0;
+                if (frame || (text && x > margin + 12 && x < width - margin - 12))
+                    line[x] = 30 + random.next(40);
+            }
+        }
+        return image;
+    }
+
+    QImage colorDisc(int width, int height, quint32 seed) {
+        QImage image(width, height, QImage::Format_RGB32);
+        Random random(seed);
+        const int r2 = qMin(width, height) * qMin(width, height) / 9;
+        for (int y = 0; y < height; y++) {
+            QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+            for (int x = 0; x < width; x++) {
+                const int dx = x - width / 2, dy = y - height / 2;
+                const int n = random.next(16);
+                line[x] = dx * dx + dy * dy < r2 ? qRgb(200 + n, 40 + n, 60)
+                                                 : qRgb(x * 255 / width, y * 255 / height, 128 + n);
+            }
+        }
+        return image;
+    }
+
+    struct Sample {
+        QString name;
+        QImage image;
+    };
+
+    QVector<Sample> corpus() {
+        QVector<Sample> samples;
+
+        QImage gradient(320, 240, QImage::Format_Grayscale8);
+        for (int y = 0; y < gradient.height(); y++) {
+            for (int x = 0; x < gradient.width(); x++) {
+                gradient.scanLine(y)[x] = (x * 255 / 319 + y) / 2;
+            }
+        }
+        samples.append({ "gradient", gradient });
+
+        QImage checker(257, 199, QImage::Format_Grayscale8);
+        for (int y = 0; y < checker.height(); y++) {
+            for (int x = 0; x < checker.width(); x++) {
+                checker.scanLine(y)[x] = ((x / 16 + y / 16) & 1) ? 215 : 40;
+            }
+        }
+        samples.append({ "checker", checker });
+
+        samples.append({ "page", page(640, 480, 7) });
+        samples.append({ "noise", noise(131, 97, QImage::Format_Grayscale8, 11) });
+        samples.append({ "disc", colorDisc(199, 257, 13) });
+
+        // sample scans, if any were put next to the tests
+        QDir data(SAMPLE_DIR);
+        foreach (const QFileInfo& info, data.entryInfoList(QStringList() << "*.png" << "*.jpg" << "*.tif" << "*.bmp",
+                                                          QDir::Files, QDir::Name)) {
+            QImage image(info.filePath());
+            if (image.isNull())
+                continue;
+            samples.append({ info.completeBaseName(),
+                             image.allGray() ? image.convertToFormat(QImage::Format_Grayscale8)
+                                             : image.convertToFormat(QImage::Format_RGB32) });
+        }
+        return samples;
+    }
+
+    // largest difference of any byte, -1 when sizes or formats differ
+    int maxDifference(const QImage& a, const QImage& b) {
+        if (a.size() != b.size() || a.format() != b.format())
+            return -1;
+
+        int diff = 0;
+        const int bytes = a.width() * a.depth() / 8;
+        for (int y = 0; y < a.height(); y++) {
+            const quint8 *la = a.constScanLine(y);
+            const quint8 *lb = b.constScanLine(y);
+            for (int x = 0; x < bytes; x++) {
+                diff = qMax(diff, qAbs(la[x] - lb[x]));
+            }
+        }
+        return diff;
+    }
+
+    // share of the pixels that differ at all, for edge maps where any
+    // difference is a whole edge pixel gained or lost
+    double differingShare(const QImage& a, const QImage& b) {
+        if (a.size() != b.size() || a.format() != b.format() || a.isNull())
+            return 1;
+
+        qint64 differing = 0;
+        const int channels = a.depth() / 8;
+        for (int y = 0; y < a.height(); y++) {
+            const quint8 *la = a.constScanLine(y);
+            const quint8 *lb = b.constScanLine(y);
+            for (int x = 0; x < a.width(); x++) {
+                if (memcmp(la + x * channels, lb + x * channels, channels) != 0)
+                    differing++;
+            }
+        }
+        return double(differing) / (qint64(a.width()) * a.height());
+    }
+
+    // of the pixels only, not of the row padding
+    QByteArray imageHash(const QImage& image) {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(QByteArray::number(image.width()) + 'x' + QByteArray::number(image.height())
+                     + ':' + QByteArray::number(int(image.format())));
+        const int bytes = (image.width() * image.depth() + 7) / 8;
+        for (int y = 0; y < image.height(); y++) {
+            hash.addData(reinterpret_cast<const char*>(image.constScanLine(y)), bytes);
+        }
+        return hash.result().toHex();
+    }
+
+    QImage grayOf(const QImage& image) {
+        if (image.format() == QImage::Format_Grayscale8)
+            return image;
+        QImage gray(image.size(), QImage::Format_Grayscale8);
+        for (int y = 0; y < image.height(); y++) {
+            const QRgb *src = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            for (int x = 0; x < image.width(); x++) {
+                gray.scanLine(y)[x] = qGray(src[x]);
+            }
+        }
+        return gray;
+    }
+
+    bool environmentFlag(const char *name) {
+        return qgetenv(name).toInt() != 0;
+    }
+
+    // "name value" lines, # starts a comment
+    QMap<QString, QString> readBaseline(const QString& fileName) {
+        QMap<QString, QString> entries;
+        QFile file(QDir(BASELINE_DIR).filePath(fileName));
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return entries;
+
+        QTextStream in(&file);
+        while (!in.atEnd()) {
+            const QString line = in.readLine().trimmed();
+            if (line.isEmpty() || line.startsWith('#'))
+                continue;
+            const QStringList fields = line.split(' ', QString::SkipEmptyParts);
+            if (fields.size() == 2)
+                entries.insert(fields[0], fields[1]);
+        }
+        return entries;
+    }
+
+    bool writeBaseline(const QString& fileName, const QString& comment, const QMap<QString, QString>& entries) {
+        QDir().mkpath(BASELINE_DIR);
+        QFile file(QDir(BASELINE_DIR).filePath(fileName));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate))
+            return false;
+
+        QTextStream out(&file);
+        out << "# " << comment << "\n";
+        for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+            out << it.key() << ' ' << it.value() << "\n";
+        }
+        return true;
+    }
+
+    // --- scalar references ---
+
+    // same zero padding, truncation and alpha handling as convolution()
+    template<class T>
+    QImage referenceConvolution(const Matrix<T>& kernel, const QImage& image) {
+        QImage out(image.size(), image.format());
+        const int k = kernel.size();
+        const int offset = k / 2;
+        const int channels = image.depth() / 8;
+        const int alpha = channels == 4 ? alphaByteIndex() : -1;
+
+        for (int y = 0; y < image.height(); y++) {
+            for (int x = 0; x < image.width(); x++) {
+                for (int c = 0; c < channels; c++) {
+                    quint8 *dst = out.scanLine(y) + x * channels + c;
+                    if (c == alpha) {
+                        *dst = image.constScanLine(y)[x * channels + c];
+                        continue;
+                    }
+                    double sum = 0;
+                    for (int j = 0; j < k; j++) {
+                        for (int i = 0; i < k; i++) {
+                            const int sx = x + i - offset, sy = y + j - offset;
+                            if (sx < 0 || sy < 0 || sx >= image.width() || sy >= image.height())
+                                continue;
+                            sum += kernel[j][i] * image.constScanLine(sy)[sx * channels + c];
+                        }
+                    }
+                    *dst = qBound(0x00, static_cast<int>(sum), 0xFF);
+                }
+            }
+        }
+        return out;
+    }
+
+    // strong seeds away from the border, grown to 8-neighbours above tmin until stable
+    QImage referenceHysteresis(const QImage& image, int tmin, int tmax) {
+        QImage res(image.size(), QImage::Format_Grayscale8);
+        res.fill(0x00);
+        for (int y = 1; y < image.height() - 1; y++) {
+            for (int x = 1; x < image.width() - 1; x++) {
+                if (image.constScanLine(y)[x] >= tmax)
+                    res.scanLine(y)[x] = 0xFF;
+            }
+        }
+
+        for (bool grown = true; grown; ) {
+            grown = false;
+            for (int y = 0; y < image.height(); y++) {
+                for (int x = 0; x < image.width(); x++) {
+                    if (res.constScanLine(y)[x] || image.constScanLine(y)[x] < tmin)
+                        continue;
+                    for (int j = -1; j <= 1 && !res.constScanLine(y)[x]; j++) {
+                        for (int i = -1; i <= 1; i++) {
+                            const int sx = x + i, sy = y + j;
+                            if (sx >= 0 && sy >= 0 && sx < image.width() && sy < image.height()
+                                    && res.constScanLine(sy)[sx]) {
+                                res.scanLine(y)[x] = 0xFF;
+                                grown = true;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return res;
+    }
+
+    // rect window clipped to the image
+    QImage referenceMorphology(const QImage& image, int w, int h, bool dilate) {
+        QImage res(image.size(), QImage::Format_Grayscale8);
+        for (int y = 0; y < image.height(); y++) {
+            for (int x = 0; x < image.width(); x++) {
+                int v = dilate ? 0x00 : 0xFF;
+                for (int j = 0; j < h; j++) {
+                    for (int i = 0; i < w; i++) {
+                        const int sx = x - w / 2 + i, sy = y - h / 2 + j;
+                        if (sx < 0 || sy < 0 || sx >= image.width() || sy >= image.height())
+                            continue;
+                        const int p = image.constScanLine(sy)[sx];
+                        v = dilate ? qMax(v, p) : qMin(v, p);
+                    }
+                }
+                res.scanLine(y)[x] = v;
+            }
+        }
+        return res;
+    }
+
+    // replicated border, alpha copied
+    QImage referenceMedian(const QImage& image, int radius) {
+        QImage res(image.size(), image.format());
+        const int channels = image.depth() / 8;
+        const int alpha = channels == 4 ? alphaByteIndex() : -1;
+        std::vector<int> window;
+
+        for (int y = 0; y < image.height(); y++) {
+            for (int x = 0; x < image.width(); x++) {
+                for (int c = 0; c < channels; c++) {
+                    window.clear();
+                    for (int j = -radius; j <= radius; j++) {
+                        for (int i = -radius; i <= radius; i++) {
+                            const int sx = qBound(0, x + i, image.width() - 1);
+                            const int sy = qBound(0, y + j, image.height() - 1);
+                            window.push_back(image.constScanLine(sy)[sx * channels + c]);
+                        }
+                    }
+                    std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+                    res.scanLine(y)[x * channels + c] = c == alpha ? image.constScanLine(y)[x * channels + c]
+                                                                   : window[window.size() / 2];
+                }
+            }
+        }
+        return res;
+    }
+
+    // binomial 5x5 at every second pixel, replicated border, rounded
+    QImage referencePyrDown(const QImage& image) {
+        static const int taps[5] = { 1, 4, 6, 4, 1 };
+        QImage res((image.width() + 1) / 2, (image.height() + 1) / 2, QImage::Format_Grayscale8);
+        for (int y = 0; y < res.height(); y++) {
+            for (int x = 0; x < res.width(); x++) {
+                int sum = 0;
+                for (int j = 0; j < 5; j++) {
+                    const int sy = qBound(0, 2 * y + j - 2, image.height() - 1);
+                    for (int i = 0; i < 5; i++) {
+                        const int sx = qBound(0, 2 * x + i - 2, image.width() - 1);
+                        sum += taps[j] * taps[i] * image.constScanLine(sy)[sx];
+                    }
+                }
+                res.scanLine(y)[x] = (sum + 128) >> 8;
+            }
+        }
+        return res;
+    }
+
+    QImage referenceLocalMean(const QImage& image, int radius) {
+        QImage res(image.size(), QImage::Format_Grayscale8);
+        for (int y = 0; y < image.height(); y++) {
+            for (int x = 0; x < image.width(); x++) {
+                quint64 sum = 0, count = 0;
+                for (int sy = qMax(0, y - radius); sy <= qMin(image.height() - 1, y + radius); sy++) {
+                    for (int sx = qMax(0, x - radius); sx <= qMin(image.width() - 1, x + radius); sx++) {
+                        sum += image.constScanLine(sy)[sx];
+                        count++;
+                    }
+                }
+                res.scanLine(y)[x] = quint8((sum + count / 2) / count);
+            }
+        }
+        return res;
+    }
+
+    // bilinear in double precision, same pixel centre convention as rotate()
+    QImage referenceRotate(const QImage& image, double degrees, quint8 fill) {
+        QImage res(image.size(), QImage::Format_Grayscale8);
+        const double angle = qDegreesToRadians(degrees);
+        const double c = std::cos(angle), s = std::sin(angle);
+        const double cx = image.width() / 2.0, cy = image.height() / 2.0;
+        auto pixel = [&](int x, int y) -> double {
+            if (x < 0 || y < 0 || x >= image.width() || y >= image.height())
+                return fill;
+            return image.constScanLine(y)[x];
+        };
+
+        for (int y = 0; y < image.height(); y++) {
+            for (int x = 0; x < image.width(); x++) {
+                const double dx = x + 0.5 - cx, dy = y + 0.5 - cy;
+                const double sx = cx + dx * c + dy * s - 0.5;
+                const double sy = cy - dx * s + dy * c - 0.5;
+                const int x0 = qFloor(sx), y0 = qFloor(sy);
+                const double fx = sx - x0, fy = sy - y0;
+                const double top = pixel(x0, y0) * (1 - fx) + pixel(x0 + 1, y0) * fx;
+                const double bottom = pixel(x0, y0 + 1) * (1 - fx) + pixel(x0 + 1, y0 + 1) * fx;
+                res.scanLine(y)[x] = quint8(qRound(top * (1 - fy) + bottom * fy));
+            }
+        }
+        return res;
+    }
+
+    // the way the viewer runs a filter in ROI mode: padded tiles, committed one
+    // by one in the output format of the job, converted once when done
+    QImage filterByTiles(const QImage& image, RoiFilterJob::Filter filter, int halo, QImage::Format format) {
+        RoiFilterJob job(image, filter, halo, format, 64);
+        QImage res = image.convertToFormat(job.outputFormat());
+        const QRect visible(image.width() / 3, image.height() / 3, image.width() / 3, image.height() / 3);
+
+        const QRect region = job.takeRegion(visible);
+        RoiFilterJob::commitRegion(res, region, job.filterRegion(region));
+        while (!job.isDone()) {
+            const QRect tile = job.takeNextTile(visible);
+            RoiFilterJob::commitRegion(res, tile, job.filterRegion(tile));
+        }
+        return res.convertToFormat(job.targetFormat());
+    }
+
+    // the way BandPrinter prints a page without rotation: bands of bandHeight
+    // target rows, each cut from the source with the margin of the resampling
+    // filter, toned and resampled on its own
+    QImage printByBands(const QImage& image, double scale, const Lut& lut, int bandHeight) {
+        const QSize target(qMax(1, qRound(image.width() * scale)), qMax(1, qRound(image.height() * scale)));
+        QImage res(target, image.format());
+        const int margin = qCeil(3 / qMin(1.0, scale)) + 1;
+
+        for (int y0 = 0; y0 < target.height(); y0 += bandHeight) {
+            const int y1 = qMin(y0 + bandHeight, target.height());
+            const int sy0 = qMax(0, qFloor(y0 / scale) - margin);
+            const int sy1 = qMin(image.height(), qCeil(y1 / scale) + margin);
+            const QImage chunk = applyLut(image.copy(0, sy0, image.width(), sy1 - sy0), lut);
+            const QImage band = resampleRows(chunk, sy0, image.height(), target, y0, y1);
+            for (int y = y0; y < y1; y++) {
+                memcpy(res.scanLine(y), band.constScanLine(y - y0), target.width() * res.depth() / 8);
+            }
+        }
+        return res;
+    }
+
+    Matrix<double> gaborKernel(int index) {
+        // same bank as the viewer: six orientations 30 degrees apart
+        const double lambda = 3;
+        return getGaborKernel(0.56 * lambda, index * M_PI / 6, lambda, 0.1, 0.0);
+    }
+
+    typedef std::function<QImage(const QImage&)> Operation;
+
+    struct NamedOperation {
+        QString name;
+        Operation apply;
+    };
+
+    // every operation gets Grayscale8 images, the colour ones get the RGB32 samples too
+    QVector<NamedOperation> grayOperations() {
+        QVector<NamedOperation> ops;
+        ops.append({ "gaussian", [](const QImage& i) { return convolution(getGaussianKernel(1.0), i); } });
+        ops.append({ "sobel", [](const QImage& i) { return sobel(i); } });
+        ops.append({ "canny", [](const QImage& i) { return canny(i, 1, 40, 120); } });
+        ops.append({ "hysteresis", [](const QImage& i) { return hysteresis(i, 40, 120); } });
+        for (int a = 0; a < 6; a++) {
+            ops.append({ QString("gabor%1").arg(a), [a](const QImage& i) { return convolution(gaborKernel(a), i); } });
+        }
+        ops.append({ "localMean", [](const QImage& i) { return localMean(i, 7); } });
+        ops.append({ "sauvola", [](const QImage& i) { return sauvola(i, 15, 0.34, 128); } });
+        ops.append({ "niblack", [](const QImage& i) { return niblack(i, 15, -0.2); } });
+        ops.append({ "median", [](const QImage& i) { return medianFilter(i, 3); } });
+        ops.append({ "bilateral", [](const QImage& i) { return bilateralFilter(i, 4, 25); } });
+        ops.append({ "erode", [](const QImage& i) { return erode(i, 5, 5); } });
+        ops.append({ "dilate", [](const QImage& i) { return dilate(i, 5, 5); } });
+        ops.append({ "openingBinary", [](const QImage& i) { return opening(sauvola(i, 15, 0.34, 128), 3, 3); } });
+        ops.append({ "pyrDown", [](const QImage& i) { return pyrDown(i); } });
+        ops.append({ "multiScaleCanny", [](const QImage& i) { return multiScaleCanny(i, 3, 40, 120); } });
+        ops.append({ "resample", [](const QImage& i) { return resample(i, i.size() * 0.61); } });
+        ops.append({ "rotate", [](const QImage& i) { return rotate(i, 7); } });
+        ops.append({ "clahe", [](const QImage& i) { return clahe(i, 8, 2.0); } });
+        ops.append({ "levels", [](const QImage& i) { return applyLut(i, levelsLut(20, 230, 0.8)); } });
+        return ops;
+    }
+
+    QVector<NamedOperation> colorOperations() {
+        QVector<NamedOperation> ops;
+        ops.append({ "gaussianColor", [](const QImage& i) { return convolution(getGaussianKernel(1.0), i); } });
+        ops.append({ "cannyColor", [](const QImage& i) { return cannyColor(i, 1, 40, 120); } });
+        for (int a = 0; a < 6; a++) {
+            ops.append({ QString("gaborLuma%1").arg(a), [a](const QImage& i) { return lumaConvolution(gaborKernel(a), i); } });
+        }
+        ops.append({ "medianColor", [](const QImage& i) { return medianFilter(i, 2); } });
+        ops.append({ "resampleColor", [](const QImage& i) { return resample(i, i.size() * 0.61); } });
+        ops.append({ "rotateColor", [](const QImage& i) { return rotate(i, -4); } });
+        ops.append({ "levelsColor", [](const QImage& i) { return applyLut(i, levelsLut(20, 230, 0.8)); } });
+        return ops;
+    }
+}
+
+
+class TestAlgorithms : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    // optimized paths against the scalar references
+    void rgbToLuma();
+    void convolution();
+    void gaborBank();
+    void hysteresis();
+    void cannyStages();
+    void threadedMatchesSerial();
+    void roiTiles();
+    void roiTilesApproximate();
+    void bandSeams();
+    void pageStore();
+    void localMean();
+    void pyrDown();
+    void morphology();
+    void median();
+    void rotate();
+    void deskew();
+    void toneLut();
+
+    // outputs and speed against the stored baselines
+    void golden();
+    void throughput();
+};
+
+void TestAlgorithms::rgbToLuma()
+{
+    const QImage image = noise(67, 3, QImage::Format_RGB32, 1);
+    // every count, so the vector loop and the scalar tail are both used
+    for (int count = 0; count <= image.width(); count++) {
+        for (int y = 0; y < image.height(); y++) {
+            const QRgb *src = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            std::vector<quint8> luma(count + 1, 0xAB);
+            algorithms::rgbToLuma(src, luma.data(), count);
+            for (int x = 0; x < count; x++) {
+                QCOMPARE(int(luma[x]), qGray(src[x]));
+            }
+            QCOMPARE(int(luma[count]), 0xAB);
+        }
+    }
+}
+
+void TestAlgorithms::convolution()
+{
+    const Matrix<double> gaussian = getGaussianKernel(1.4);
+    foreach (QImage::Format format, QList<QImage::Format>() << QImage::Format_Grayscale8
+             << QImage::Format_RGB32 << QImage::Format_ARGB32) {
+        const QImage image = noise(97, 61, format, 2);
+        QVERIFY(maxDifference(algorithms::convolution(gaussian, image), referenceConvolution(gaussian, image)) <= RoundingTolerance);
+        QVERIFY(maxDifference(algorithms::convolution(sobelx, image), referenceConvolution(sobelx, image)) <= ExactTolerance);
+    }
+}
+
+void TestAlgorithms::gaborBank()
+{
+    // luminance computed on the fly must match filtering a grayscale copy
+    const QImage image = colorDisc(83, 71, 3);
+    const QImage gray = grayOf(image);
+    for (int a = 0; a < 6; a++) {
+        const Matrix<double> kernel = gaborKernel(a);
+        const QImage reference = referenceConvolution(kernel, gray);
+        QVERIFY(maxDifference(lumaConvolution(kernel, image), reference) <= RoundingTolerance);
+        QVERIFY(maxDifference(algorithms::convolution(kernel, gray), reference) <= RoundingTolerance);
+    }
+}
+
+void TestAlgorithms::hysteresis()
+{
+    const QImage magnitude = sobel(page(160, 120, 4));
+    QCOMPARE(maxDifference(algorithms::hysteresis(magnitude, 40, 120), referenceHysteresis(magnitude, 40, 120)), ExactTolerance);
+
+    const QImage random = noise(73, 59, QImage::Format_Grayscale8, 5);
+    QCOMPARE(maxDifference(algorithms::hysteresis(random, 100, 200), referenceHysteresis(random, 100, 200)), ExactTolerance);
+}
+
+void TestAlgorithms::cannyStages()
+{
+    // the cached pipeline of the tuning dialog must give what canny() gives
+    const QImage image = page(200, 150, 6);
+    CannyPipeline pipeline(image, 1, 40, 120);
+    QCOMPARE(maxDifference(pipeline.result(), canny(image, 1, 40, 120)), ExactTolerance);
+
+    pipeline.setThresholds(20, 90);
+    QCOMPARE(maxDifference(pipeline.result(), canny(image, 1, 20, 90)), ExactTolerance);
+
+    pipeline.setSmoothing(Smoothing::Median);
+    QCOMPARE(maxDifference(pipeline.result(), canny(image, 1, 20, 90, Smoothing::Median)), ExactTolerance);
+}
+
+void TestAlgorithms::threadedMatchesSerial()
+{
+    const QImage gray = page(300, 220, 8);
+    const QImage color = colorDisc(240, 180, 9);
+    const QVector<NamedOperation> ops = grayOperations();
+    const QVector<NamedOperation> colorOps = colorOperations();
+
+    // the bands are the same whatever the pool size, so with a single pool
+    // thread any difference comes from a race between bands
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int threads = pool->maxThreadCount();
+    QVector<QImage> serial;
+    pool->setMaxThreadCount(1);
+    foreach (const NamedOperation& op, ops) {
+        serial.append(op.apply(gray));
+    }
+    foreach (const NamedOperation& op, colorOps) {
+        serial.append(op.apply(color));
+    }
+    pool->setMaxThreadCount(threads);
+
+    for (int i = 0; i < ops.size(); i++) {
+        QVERIFY2(maxDifference(ops[i].apply(gray), serial[i]) == ExactTolerance, qPrintable(ops[i].name));
+    }
+    for (int i = 0; i < colorOps.size(); i++) {
+        QVERIFY2(maxDifference(colorOps[i].apply(color), serial[ops.size() + i]) == ExactTolerance,
+                 qPrintable(colorOps[i].name));
+    }
+}
+
+void TestAlgorithms::roiTiles()
+{
+    // local filters with their halo must not show the tile seams
+    const QImage gray = page(300, 200, 10);
+    const QImage color = colorDisc(150, 130, 11);
+
+    auto check = [](const QImage& image, Operation filter, int halo, QImage::Format format) {
+        return maxDifference(filterByTiles(image, filter, halo, format), filter(image).convertToFormat(format));
+    };
+
+    QCOMPARE(check(gray, [](const QImage& i) { return algorithms::convolution(getGaussianKernel(1.0), i); }, 2,
+                   QImage::Format_Grayscale8), ExactTolerance);
+    QCOMPARE(check(color, [](const QImage& i) { return algorithms::convolution(getGaussianKernel(1.0), i); }, 2,
+                   QImage::Format_RGB32), ExactTolerance);
+    QCOMPARE(check(gray, [](const QImage& i) { return sauvola(i, 15, 0.34, 128); }, 15,
+                   QImage::Format_Grayscale8), ExactTolerance);
+    QCOMPARE(check(gray, [](const QImage& i) { return medianFilter(i, 3); }, 3,
+                   QImage::Format_Grayscale8), ExactTolerance);
+    QCOMPARE(check(gray, [](const QImage& i) { return erode(i, 5, 5); }, 2,
+                   QImage::Format_Grayscale8), ExactTolerance);
+
+    // the dice of a pixel depend on the seed and its image position only
+    QCOMPARE(check(color, [](const QImage& i) { return randomBlur(i, 12345); }, 3,
+                   QImage::Format_RGB32), ExactTolerance);
+    // tiles of a palette image carry its colour table
+    QCOMPARE(check(indexedNoise(150, 130, 31), [](const QImage& i) { return randomBlur(i, 12345); }, 3,
+                   QImage::Format_RGB32), ExactTolerance);
+    // palette and 1-bit pages are filtered as colour tiles and converted back
+    // to their format once; a width of whole bytes, so every Mono pixel is compared
+    QCOMPARE(check(indexedNoise(150, 130, 34), [](const QImage& i) { return medianFilter(i, 3); }, 3,
+                   QImage::Format_Indexed8), ExactTolerance);
+    QCOMPARE(check(monoNoise(160, 130, 35), [](const QImage& i) { return medianFilter(i, 3); }, 3,
+                   QImage::Format_Mono), ExactTolerance);
+    // the grid blur reaches four spatial sigmas, the halo the viewer uses
+    QCOMPARE(check(gray, [](const QImage& i) { return bilateralFilter(i, 4, 25); }, 16,
+                   QImage::Format_Grayscale8), ExactTolerance);
+    QCOMPARE(check(color, [](const QImage& i) { return bilateralFilter(i, 4, 25); }, 16,
+                   QImage::Format_RGB32), ExactTolerance);
+}
+
+void TestAlgorithms::roiTilesApproximate()
+{
+    // hysteresis reaches further than any halo, how far the tiles may stray
+    const QImage gray = page(300, 200, 22);
+
+    // canny on tiles with an 8 px halo, weak edges near the seams may be lost
+    const QImage tiled = filterByTiles(gray, [](const QImage& i) { return canny(i, 1, 40, 120); }, 8,
+                                       QImage::Format_Grayscale8);
+    QVERIFY(differingShare(tiled, canny(gray, 1, 40, 120)) <= CannyTileShare);
+
+    // the tuning dialog previews hysteresis tile by tile with HysteresisHalo
+    // on the cached suppression, and accepts the whole image
+    CannyPipeline pipeline(gray, 1, 20, 90);
+    const double tmin = pipeline.tmin(), tmax = pipeline.tmax();
+    const QImage preview = filterByTiles(pipeline.suppressed(), [tmin, tmax](const QImage& i) {
+        return algorithms::hysteresis(i, tmin, tmax);
+    }, CannyPipeline::HysteresisHalo, QImage::Format_Grayscale8);
+    QVERIFY(differingShare(preview, pipeline.result()) <= CannyTileShare);
+}
+
+void TestAlgorithms::bandSeams()
+{
+    // a page printed in bands must equal the page resampled at once,
+    // shrunk, enlarged and around the band height
+    const QImage gray = page(301, 517, 24);
+    const QImage color = colorDisc(211, 389, 25);
+    const Lut lut = levelsLut(20, 230, 0.8);
+
+    foreach (double scale, QList<double>() << 0.09 << 0.37 << 1.0 << 1.7 << 3.1) {
+        foreach (const QImage& image, QList<QImage>() << gray << color) {
+            const QSize target(qMax(1, qRound(image.width() * scale)), qMax(1, qRound(image.height() * scale)));
+            const QImage whole = resample(applyLut(image, lut), target);
+            foreach (int bandHeight, QList<int>() << 1 << 37 << 256) {
+                QCOMPARE(maxDifference(printByBands(image, scale, lut, bandHeight), whole), ExactTolerance);
+            }
+        }
+    }
+}
+
+void TestAlgorithms::pageStore()
+{
+    // pages leaving the prefetch window are compressed and must come back as they were
+    const QImage mono = monoNoise(203, 67, 26);
+    const QImage indexed = indexedNoise(97, 300, 27);
+
+    const QList<QImage> images = QList<QImage>() << page(700, 530, 28) << colorDisc(300, 620, 29)
+                                                 << noise(513, 257, QImage::Format_ARGB32, 30)
+                                                 << mono << indexed;
+
+    PageStore store(1);
+    for (int i = 0; i < images.size(); i++) {
+        QCOMPARE(store.append(images[i], QString("page%1").arg(i), i == 1 ? images[0] : QImage()), i);
+    }
+    QCOMPARE(store.count(), images.size());
+
+    // in order, backwards and jumping, so every page is evicted and restored
+    const QList<int> visits = QList<int>() << 0 << 1 << 2 << 3 << 4 << 3 << 0 << 4 << 2 << 0 << 3;
+    foreach (int index, visits) {
+        store.setActive(index);
+        QCOMPARE(store.active(), index);
+        for (int i = 0; i < images.size(); i++) {
+            const QImage image = store.image(i);
+            QCOMPARE(image.format(), images[i].format());
+            QCOMPARE(image.colorTable(), images[i].colorTable());
+            QCOMPARE(imageHash(image), imageHash(images[i]));
+            QCOMPARE(store.name(i), QString("page%1").arg(i));
+        }
+    }
+    QCOMPARE(imageHash(store.original(1)), imageHash(images[0]));
+    QVERIFY(store.original(2).isNull());
+
+    // parts of compressed pages, across tile borders and off byte boundaries,
+    // come from their tiles and leave the page compressed
+    store.setActive(0);
+    const qint64 decompressed = store.usage().decompressedBytes;
+    foreach (const QRect& rect, QList<QRect>() << QRect(250, 3, 13, 260) << QRect(5, 40, 90, 20)
+                                                << QRect(97, 10, 51, 50) << QRect(0, 0, 600, 600)) {
+        for (int i = 2; i <= 3; i++) {
+            if (!rect.intersects(images[i].rect()))
+                continue;
+            const QImage region = store.region(i, rect);
+            const QImage expected = images[i].copy(rect.intersected(images[i].rect()));
+            QCOMPARE(region.format(), expected.format());
+            QCOMPARE(region.colorTable(), expected.colorTable());
+            // the padding bits after the last pixel of a Mono row are not compared
+            QCOMPARE(maxDifference(region.convertToFormat(QImage::Format_ARGB32),
+                                   expected.convertToFormat(QImage::Format_ARGB32)), ExactTolerance);
+        }
+    }
+    QCOMPARE(store.usage().decompressedBytes, decompressed);
+
+    const PageStore::Usage usage = store.usage();
+    QVERIFY(usage.compressedBytes > 0);
+    QVERIFY(usage.decompressedBytes < usage.rawBytes);
+
+    store.clear();
+    QVERIFY(store.isEmpty());
+}
+
+void TestAlgorithms::localMean()
+{
+    const QImage image = noise(90, 77, QImage::Format_Grayscale8, 12);
+    foreach (int radius, QList<int>() << 0 << 1 << 7 << 50) {
+        QCOMPARE(maxDifference(algorithms::localMean(image, radius), referenceLocalMean(image, radius)), ExactTolerance);
+    }
+}
+
+void TestAlgorithms::pyrDown()
+{
+    // widths around the 8 and 16 pixel vector blocks
+    const QList<QSize> sizes = QList<QSize>() << QSize(1, 1) << QSize(2, 3) << QSize(15, 9) << QSize(16, 16)
+                                              << QSize(17, 5) << QSize(33, 40) << QSize(257, 130);
+    foreach (const QSize& size, sizes) {
+        const QImage image = noise(size.width(), size.height(), QImage::Format_Grayscale8, 13);
+        QCOMPARE(maxDifference(algorithms::pyrDown(image), referencePyrDown(image)), ExactTolerance);
+    }
+
+    const QVector<QImage> pyramid = gaussianPyramid(page(640, 480, 14), 4);
+    QCOMPARE(pyramid.size(), 4);
+    QCOMPARE(pyramid.last().size(), QSize(80, 60));
+}
+
+void TestAlgorithms::morphology()
+{
+    const QImage gray = noise(157, 93, QImage::Format_Grayscale8, 15);
+    QImage binary = noise(157, 93, QImage::Format_Grayscale8, 16);
+    for (int y = 0; y < binary.height(); y++) {
+        for (int x = 0; x < binary.width(); x++) {
+            binary.scanLine(y)[x] = binary.scanLine(y)[x] < 50 ? 0xFF : 0x00;
+        }
+    }
+    QVERIFY(isBinary(binary));
+
+    // the binary image goes through the bit-packed path, rows longer than a word included
+    const QList<QSize> elements = QList<QSize>() << QSize(1, 1) << QSize(3, 3) << QSize(4, 6)
+                                                 << QSize(9, 2) << QSize(65, 3) << QSize(2, 70);
+    foreach (const QSize& e, elements) {
+        foreach (const QImage& image, QList<QImage>() << gray << binary) {
+            QCOMPARE(maxDifference(erode(image, e.width(), e.height()),
+                                   referenceMorphology(image, e.width(), e.height(), false)), ExactTolerance);
+            QCOMPARE(maxDifference(dilate(image, e.width(), e.height()),
+                                   referenceMorphology(image, e.width(), e.height(), true)), ExactTolerance);
+        }
+    }
+}
+
+void TestAlgorithms::median()
+{
+    foreach (QImage::Format format, QList<QImage::Format>() << QImage::Format_Grayscale8 << QImage::Format_ARGB32) {
+        const QImage image = noise(83, 45, format, 17);
+        foreach (int radius, QList<int>() << 0 << 1 << 3 << 20) {
+            QCOMPARE(maxDifference(medianFilter(image, radius), referenceMedian(image, radius)), ExactTolerance);
+        }
+    }
+
+    // palette and 24-bit pixels are filtered as the colours they stand for
+    const QImage indexed = indexedNoise(83, 45, 32);
+    const QImage rgb = indexed.convertToFormat(QImage::Format_RGB32);
+    QCOMPARE(maxDifference(medianFilter(indexed, 2), medianFilter(rgb, 2)), ExactTolerance);
+    QCOMPARE(maxDifference(medianFilter(indexed.convertToFormat(QImage::Format_RGB888), 2), medianFilter(rgb, 2)),
+             ExactTolerance);
+    QCOMPARE(maxDifference(bilateralFilter(indexed, 4, 25), bilateralFilter(rgb, 4, 25)), ExactTolerance);
+}
+
+void TestAlgorithms::rotate()
+{
+    const QImage image = page(121, 87, 18);
+    foreach (double degrees, QList<double>() << 0.0 << 1.5 << -7.0 << 33.0) {
+        // 16.16 source positions and 8-bit weights against doubles
+        QVERIFY(maxDifference(algorithms::rotate(image, degrees), referenceRotate(image, degrees, 0xFF)) <= RoundingTolerance);
+    }
+}
+
+void TestAlgorithms::deskew()
+{
+    // a page turned by a known angle is found within the refining step
+    const QImage image = page(900, 1200, 33);
+    foreach (double degrees, QList<double>() << 0.0 << 0.5 << -1.3 << 3.7 << -7.1 << 9.7) {
+        QVERIFY(qAbs(detectSkew(algorithms::rotate(image, degrees)) - degrees) <= SkewStep);
+    }
+}
+
+void TestAlgorithms::toneLut()
+{
+    const QImage gray = noise(61, 37, QImage::Format_Grayscale8, 19);
+    const QImage color = noise(61, 37, QImage::Format_ARGB32, 20);
+    const Lut lut = composeLut(levelsLut(20, 230, 0.8),
+                               curveLut(QVector<QPointF>() << QPointF(64, 50) << QPointF(192, 210)));
+
+    const QImage mapped = applyLut(gray, lut);
+    const QImage mappedColor = applyLut(color, lut);
+    Histogram expected;
+    memset(&expected, 0, sizeof(expected));
+    for (int y = 0; y < gray.height(); y++) {
+        for (int x = 0; x < gray.width(); x++) {
+            QCOMPARE(int(mapped.constScanLine(y)[x]), int(lut[gray.constScanLine(y)[x]]));
+            expected.luma[gray.constScanLine(y)[x]]++;
+
+            const QRgb in = color.pixel(x, y), out = mappedColor.pixel(x, y);
+            QCOMPARE(qRed(out), int(lut[qRed(in)]));
+            QCOMPARE(qGreen(out), int(lut[qGreen(in)]));
+            QCOMPARE(qBlue(out), int(lut[qBlue(in)]));
+            QCOMPARE(qAlpha(out), qAlpha(in));
+        }
+    }
+
+    const Histogram counted = histogram(gray);
+    QVERIFY(memcmp(counted.luma, expected.luma, sizeof(expected.luma)) == 0);
+
+    // palette images get their colour table mapped, the indices are kept
+    foreach (const QImage& image, QList<QImage>() << indexedNoise(61, 37, 21) << monoNoise(61, 37, 22)) {
+        const QImage toned = applyLut(image, lut);
+        QCOMPARE(toned.format(), image.format());
+        for (int y = 0; y < image.height(); y++) {
+            for (int x = 0; x < image.width(); x++) {
+                const QRgb in = image.pixel(x, y), out = toned.pixel(x, y);
+                QCOMPARE(qRed(out), int(lut[qRed(in)]));
+                QCOMPARE(qGreen(out), int(lut[qGreen(in)]));
+                QCOMPARE(qBlue(out), int(lut[qBlue(in)]));
+            }
+        }
+
+        const Histogram palette = histogram(image);
+        const Histogram colors = histogram(image.convertToFormat(QImage::Format_RGB32));
+        QVERIFY(memcmp(&palette, &colors, sizeof(Histogram)) == 0);
+    }
+}
+
+void TestAlgorithms::golden()
+{
+    const bool record = environmentFlag("QIV_RECORD_GOLDEN");
+    const QMap<QString, QString> baseline = readBaseline("golden.txt");
+    QVERIFY2(!baseline.isEmpty() || record, "tests/baselines/golden.txt is missing");
+
+    QMap<QString, QString> hashes;
+    foreach (const Sample& sample, corpus()) {
+        const QImage gray = sample.image.format() == QImage::Format_Grayscale8
+                ? sample.image : grayOf(sample.image);
+        foreach (const NamedOperation& op, grayOperations()) {
+            hashes.insert(sample.name + '.' + op.name, imageHash(op.apply(gray)));
+        }
+        if (sample.image.format() == QImage::Format_Grayscale8)
+            continue;
+        foreach (const NamedOperation& op, colorOperations()) {
+            hashes.insert(sample.name + '.' + op.name, imageHash(op.apply(sample.image)));
+        }
+    }
+
+    if (record) {
+        QVERIFY(writeBaseline("golden.txt", "sha1 of the filter outputs, recorded by tst_algorithms", hashes));
+        return;
+    }
+
+    QStringList changed;
+    for (auto it = hashes.constBegin(); it != hashes.constEnd(); ++it) {
+        if (!baseline.contains(it.key()))
+            qWarning("%s: no golden hash, record the baseline again", qPrintable(it.key()));
+        else if (baseline.value(it.key()) != it.value())
+            changed.append(it.key());
+    }
+    QVERIFY2(changed.isEmpty(), qPrintable("output changed: " + changed.join(", ")));
+}
+
+void TestAlgorithms::throughput()
+{
+#ifndef QT_NO_DEBUG
+    QSKIP("throughput is only gated in release builds");
+#endif
+    if (environmentFlag("QIV_SKIP_PERF"))
+        QSKIP("QIV_SKIP_PERF is set");
+
+    const bool record = environmentFlag("QIV_RECORD");
+    const QMap<QString, QString> baseline = readBaseline("throughput.txt");
+    if (baseline.isEmpty() && !record)
+        QSKIP("no throughput baseline recorded, run once with QIV_RECORD=1");
+
+    bool ok = false;
+    double tolerance = qgetenv("QIV_PERF_TOLERANCE").toDouble(&ok);
+    if (!ok)
+        tolerance = DefaultPerfTolerance;
+
+    // a 4 MP page, in the range of the scans the viewer is used for
+    const QImage gray = page(2400, 1700, 21);
+    const QImage color = gray.convertToFormat(QImage::Format_RGB32);
+
+    QVector<NamedOperation> cases;
+    cases.append({ "convolution", [](const QImage& i) { return algorithms::convolution(getGaussianKernel(1.0), i); } });
+    cases.append({ "canny", [](const QImage& i) { return canny(i, 1, 40, 120); } });
+    cases.append({ "hysteresis", [](const QImage& i) { return algorithms::hysteresis(i, 40, 120); } });
+    cases.append({ "sauvola", [](const QImage& i) { return sauvola(i, 15, 0.34, 128); } });
+    cases.append({ "median", [](const QImage& i) { return medianFilter(i, 3); } });
+    cases.append({ "bilateral", [](const QImage& i) { return bilateralFilter(i, 4, 25); } });
+    cases.append({ "erode", [](const QImage& i) { return erode(i, 15, 15); } });
+    cases.append({ "pyramid", [](const QImage& i) { return gaussianPyramid(i, 5).last(); } });
+    cases.append({ "multiScaleCanny", [](const QImage& i) { return multiScaleCanny(i, 3, 40, 120); } });
+    cases.append({ "resample", [](const QImage& i) { return resample(i, i.size() / 3); } });
+    cases.append({ "rotate", [](const QImage& i) { return algorithms::rotate(i, 3); } });
+    const int grayCases = cases.size();
+    cases.append({ "cannyColor", [](const QImage& i) { return cannyColor(i, 1, 40, 120); } });
+    cases.append({ "gaborBank", [](const QImage& i) {
+        QImage res;
+        for (int a = 0; a < 6; a++) {
+            res = lumaConvolution(gaborKernel(a), i);
+        }
+        return res;
+    } });
+
+    // best of three, the first run also warms up the buffer pool
+    QMap<QString, QString> measured;
+    QStringList regressed;
+    for (int c = 0; c < cases.size(); c++) {
+        const QImage& input = c < grayCases ? gray : color;
+        qint64 best = -1;
+        for (int run = 0; run < 3; run++) {
+            QElapsedTimer timer;
+            timer.start();
+            const QImage result = cases[c].apply(input);
+            const qint64 elapsed = timer.nsecsElapsed();
+            QVERIFY(!result.isNull());
+            if (best < 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        const double mpps = double(input.width()) * input.height() / qMax<qint64>(best, 1) * 1000;
+        measured.insert(cases[c].name, QString::number(mpps, 'f', 2));
+        qDebug("%-16s %8.2f MP/s", qPrintable(cases[c].name), mpps);
+
+        const double expected = baseline.value(cases[c].name).toDouble();
+        if (!record && expected > 0 && mpps < expected * (1 - tolerance)) {
+            regressed.append(QString("%1 (%2 MP/s, baseline %3)").arg(cases[c].name)
+                             .arg(mpps, 0, 'f', 2).arg(expected, 0, 'f', 2));
+        }
+    }
+
+    if (record) {
+        QVERIFY(writeBaseline("throughput.txt", "megapixels per second, best of three, recorded by tst_algorithms", measured));
+        return;
+    }
+    QVERIFY2(regressed.isEmpty(), qPrintable("throughput regressed: " + regressed.join(", ")));
+}
+
+QTEST_MAIN(TestAlgorithms)
+
+#include "tst_algorithms.moc"
@@ -0,0 +1,184 @@
+#include "tiledimageitem.h"
+#include "resampler.h"
+#include "tone.h"
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QAtomicInteger>
+#include <QtMath>
+
+uint qHash(const TileCache::Key& key, uint seed)
+{
+    return qHash(key.id, seed) ^ qHash(key.lut, seed) ^ qHash((key.level << 24) ^ (key.tx << 12) ^ key.ty, seed);
+}
+
+TileCache::TileCache()
+{
+    m_cache.setMaxCost(256 * 1024);
+}
+
+TileCache& TileCache::shared()
+{
+    static TileCache cache;
+    return cache;
+}
+
+quint64 TileCache::uniqueId()
+{
+    // ids of changed images, kept apart from QImage::cacheKey() values
+    static QAtomicInteger<quint64> next(1);
+    return next.fetchAndAddRelaxed(1) | (Q_UINT64_C(1) << 63);
+}
+
+// area covered by a tile, in full resolution image coordinates
+QRect TileCache::tileRect(int level, int tx, int ty)
+{
+    const int size = TileSize << level;
+    return QRect(tx * size, ty * size, size, size);
+}
+
+QPixmap TileCache::tile(const QImage& image, quint64 id, int level, int tx, int ty,
+                        const QVector<quint8>& lut, quint64 lutId)
+{
+    Key key = { id, lutId, level, tx, ty };
+    if (QPixmap *cached = m_cache.object(key))
+        return *cached;
+
+    // a tone table is applied to the cached plain tile, so moving a slider
+    // does not resample the full resolution image again
+    if (lutId) {
+        const QPixmap plain = this->tile(image, id, level, tx, ty);
+        return insert(key, algorithms::applyLut(plain.toImage(), lut));
+    }
+
+    const QRect rect = tileRect(level, tx, ty).intersected(image.rect());
+    QImage tile;
+
+    if (level == 0) {
+        tile = image.copy(rect);
+    } else {
+        // resample with a margin, so neighbouring tiles match at the seams
+        const int scale = 1 << level;
+        const int margin = 4 * scale;
+        QRect padded = rect.adjusted(-margin, -margin, margin, margin).intersected(image.rect());
+        // start on a byte for 1-bit formats, keeping the left edge on the level grid
+        if (image.depth() < 8)
+            padded.setLeft(padded.left() & ~(qMax(8, scale) - 1));
+        QImage view(image.constScanLine(padded.top()) + padded.left() * image.depth() / 8,
+                    padded.width(), padded.height(), image.bytesPerLine(), image.format());
+        // palette formats need the table to resample the right colours
+        view.setColorTable(image.colorTable());
+
+        QSize size(qMax(1, qRound(double(padded.width()) / scale)), qMax(1, qRound(double(padded.height()) / scale)));
+        QImage scaled = algorithms::resample(view, size);
+        tile = scaled.copy(qRound(double(rect.left() - padded.left()) / scale),
+                           qRound(double(rect.top() - padded.top()) / scale),
+                           qMax(1, (rect.width() + scale - 1) / scale),
+                           qMax(1, (rect.height() + scale - 1) / scale));
+    }
+
+    return insert(key, tile);
+}
+
+QPixmap TileCache::insert(const Key& key, const QImage& tile)
+{
+    QPixmap *pixmap = new QPixmap(QPixmap::fromImage(tile));
+    m_cache.insert(key, pixmap, qMax(1, pixmap->width() * pixmap->height() * pixmap->depth() / 8 / 1024));
+    return *pixmap;
+}
+
+void TileCache::rekey(quint64 from, quint64 to, const QRect& changed)
+{
+    foreach (const Key& key, m_cache.keys()) {
+        if (key.id != from)
+            continue;
+
+        const int cost = m_cache.totalCost();
+        QPixmap *pixmap = m_cache.take(key);
+        if (!pixmap || tileRect(key.level, key.tx, key.ty).intersects(changed)) {
+            delete pixmap;
+            continue;
+        }
+
+        Key moved = { to, key.lut, key.level, key.tx, key.ty };
+        m_cache.insert(moved, pixmap, cost - m_cache.totalCost());
+    }
+}
+
+
+TiledImageItem::TiledImageItem(QGraphicsItem *parent) :
+    QGraphicsItem(parent), m_image(0), m_id(0), m_clipFraction(1), m_lutId(0)
+{
+    // exposedRect is needed to paint only visible tiles
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+void TiledImageItem::setImage(const QImage *image)
+{
+    prepareGeometryChange();
+    m_image = image;
+    // the same image in another view shares its tiles
+    m_id = image ? image->cacheKey() : 0;
+    update();
+}
+
+void TiledImageItem::imageChanged(const QRect& rect)
+{
+    // a fresh id keeps views still showing the old content out of it
+    const quint64 id = TileCache::uniqueId();
+    TileCache::shared().rekey(m_id, id, rect);
+    m_id = id;
+    update(rect);
+}
+
+void TiledImageItem::setClipFraction(qreal fraction)
+{
+    m_clipFraction = qBound<qreal>(0, fraction, 1);
+    update();
+}
+
+void TiledImageItem::setLut(const QVector<quint8>& lut)
+{
+    // every table gets its own id, tiles of earlier ones age out of the cache
+    m_lut = lut;
+    m_lutId = lut.isEmpty() ? 0 : TileCache::uniqueId();
+    update();
+}
+
+QRectF TiledImageItem::boundingRect() const
+{
+    return m_image ? QRectF(m_image->rect()) : QRectF();
+}
+
+void TiledImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    Q_UNUSED(widget);
+    if (!m_image || m_image->isNull())
+        return;
+
+    // coarsest level still having at least one image pixel per screen pixel
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    int level = lod < 1 ? qFloor(std::log2(1 / lod)) : 0;
+    while (level > 0 && (TileCache::TileSize << (level - 1)) >= qMax(m_image->width(), m_image->height()))
+        level--;
+
+    QRectF exposed = option->exposedRect.intersected(boundingRect());
+    if (m_clipFraction < 1) {
+        exposed = exposed.intersected(QRectF(0, 0, m_image->width() * m_clipFraction, m_image->height()));
+    }
+    if (exposed.isEmpty())
+        return;
+
+    const int size = TileCache::TileSize << level;
+    const QRect area = exposed.toAlignedRect();
+
+    painter->save();
+    painter->setClipRect(exposed);
+    for (int ty = area.top() / size; ty <= area.bottom() / size; ty++) {
+        for (int tx = area.left() / size; tx <= area.right() / size; tx++) {
+            QPixmap tile = TileCache::shared().tile(*m_image, m_id, level, tx, ty, m_lut, m_lutId);
+            QRect target = TileCache::tileRect(level, tx, ty).intersected(m_image->rect());
+            painter->drawPixmap(QRectF(target), tile, QRectF(tile.rect()));
+        }
+    }
+    painter->restore();
+}
@@ -0,0 +1,84 @@
+#ifndef TILEDIMAGEITEM_H
+#define TILEDIMAGEITEM_H
+
+#include <QGraphicsItem>
+#include <QCache>
+#include <QPixmap>
+#include <QImage>
+#include <QVector>
+
+// Pixmap tiles of images at power-of-two levels of detail. One cache is
+// shared by every view, so panes showing the same image share its tiles.
+class TileCache
+{
+public:
+    struct Key {
+        quint64 id;
+        quint64 lut;
+        int level;
+        int tx;
+        int ty;
+
+        bool operator==(const Key& other) const {
+            return id == other.id && lut == other.lut && level == other.level
+                    && tx == other.tx && ty == other.ty;
+        }
+    };
+
+    static TileCache& shared();
+
+    // tile (tx, ty) of image downscaled by 2^level, created on demand,
+    // with the tone lookup table lut identified by lutId applied (0 for none);
+    // toned tiles are made from the cached plain tile
+    QPixmap tile(const QImage& image, quint64 id, int level, int tx, int ty,
+                 const QVector<quint8>& lut = QVector<quint8>(), quint64 lutId = 0);
+
+    // move tiles of an image to a new id, dropping the ones touching changed
+    void rekey(quint64 from, quint64 to, const QRect& changed);
+
+    static quint64 uniqueId();
+    static QRect tileRect(int level, int tx, int ty);
+
+    static const int TileSize = 256;
+
+private:
+    TileCache();
+    Q_DISABLE_COPY(TileCache)
+
+    QPixmap insert(const Key& key, const QImage& tile);
+
+    QCache<Key, QPixmap> m_cache;   // cost in KB
+};
+
+uint qHash(const TileCache::Key& key, uint seed = 0);
+
+
+// Graphics item drawing an image from cached tiles, only those exposed and at
+// the level of detail matching the view scale. The image is not copied, so
+// the owner can update it in place and report the changed region.
+class TiledImageItem : public QGraphicsItem
+{
+public:
+    explicit TiledImageItem(QGraphicsItem *parent = 0);
+
+    void setImage(const QImage *image);
+    void imageChanged(const QRect& rect);
+
+    // only draw the left part of the image, for swipe comparison
+    void setClipFraction(qreal fraction);
+
+    // tone lookup table applied to the tiles as they are drawn, empty for none
+    void setLut(const QVector<quint8>& lut);
+
+    QRectF boundingRect() const;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+
+private:
+    const QImage *m_image;
+    quint64 m_id;
+    qreal m_clipFraction;
+    QVector<quint8> m_lut;
+    quint64 m_lutId;
+};
+
+#endif // TILEDIMAGEITEM_H
@@ -0,0 +1,268 @@
+#include <QtWidgets>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "tone.h"
+#include "algorithms.h"
+#include "parallel.h"
+
+namespace algorithms
+{
+    Histogram histogram(const QImage& input) {
+        QImage image = input;
+        if (image.format() != QImage::Format_Grayscale8 && !isQRgbImage(image))
+            image = image.convertToFormat(QImage::Format_RGB32);
+
+        Histogram total;
+        memset(&total, 0, sizeof(Histogram));
+        const bool gray = image.format() == QImage::Format_Grayscale8;
+        QMutex mutex;
+
+        parallelBands(image.height(), [&](int begin, int end) {
+            Histogram local;
+            memset(&local, 0, sizeof(Histogram));
+            std::vector<quint8> luma(image.width());
+
+            for (int y = begin; y < end; y++) {
+                if (gray) {
+                    const quint8 *line = image.constScanLine(y);
+                    for (int x = 0; x < image.width(); x++) {
+                        local.luma[line[x]]++;
+                    }
+                    continue;
+                }
+
+                const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+                rgbToLuma(line, luma.data(), image.width());
+                for (int x = 0; x < image.width(); x++) {
+                    local.luma[luma[x]]++;
+                    local.red[qRed(line[x])]++;
+                    local.green[qGreen(line[x])]++;
+                    local.blue[qBlue(line[x])]++;
+                }
+            }
+
+            QMutexLocker locker(&mutex);
+            for (int i = 0; i < 256; i++) {
+                total.luma[i] += local.luma[i];
+                total.red[i] += local.red[i];
+                total.green[i] += local.green[i];
+                total.blue[i] += local.blue[i];
+            }
+        }, 64);
+
+        if (gray) {
+            memcpy(total.red, total.luma, sizeof(total.luma));
+            memcpy(total.green, total.luma, sizeof(total.luma));
+            memcpy(total.blue, total.luma, sizeof(total.luma));
+        }
+        return total;
+    }
+
+    Lut levelsLut(int black, int white, double gamma) {
+        Lut lut(256);
+        black = qBound(0, black, 254);
+        white = qBound(black + 1, white, 255);
+        gamma = qMax(0.01, gamma);
+
+        for (int i = 0; i < 256; i++) {
+            const double t = qBound(0.0, double(i - black) / (white - black), 1.0);
+            lut[i] = qRound(255 * std::pow(t, 1 / gamma));
+        }
+        return lut;
+    }
+
+    // Fritsch-Carlson tangents keep the curve monotone between control points
+    Lut curveLut(QVector<QPointF> points) {
+        std::sort(points.begin(), points.end(), [](const QPointF& a, const QPointF& b) {
+            return a.x() < b.x();
+        });
+        if (points.isEmpty() || points.first().x() > 0)
+            points.prepend(QPointF(0, 0));
+        if (points.last().x() < 255)
+            points.append(QPointF(255, 255));
+
+        const int n = points.size();
+        std::vector<double> slopes(n - 1), tangents(n);
+        for (int i = 0; i < n - 1; i++) {
+            const double dx = qMax(1e-6, points[i + 1].x() - points[i].x());
+            slopes[i] = (points[i + 1].y() - points[i].y()) / dx;
+        }
+        tangents[0] = slopes[0];
+        tangents[n - 1] = slopes[n - 2];
+        for (int i = 1; i < n - 1; i++) {
+            tangents[i] = slopes[i - 1] * slopes[i] <= 0 ? 0 : (slopes[i - 1] + slopes[i]) / 2;
+        }
+        for (int i = 0; i < n - 1; i++) {
+            if (slopes[i] == 0) {
+                tangents[i] = tangents[i + 1] = 0;
+                continue;
+            }
+            const double a = tangents[i] / slopes[i];
+            const double b = tangents[i + 1] / slopes[i];
+            if (a * a + b * b > 9) {
+                const double t = 3 / std::sqrt(a * a + b * b);
+                tangents[i] = t * a * slopes[i];
+                tangents[i + 1] = t * b * slopes[i];
+            }
+        }
+
+        Lut lut(256);
+        int segment = 0;
+        for (int i = 0; i < 256; i++) {
+            while (segment < n - 2 && i > points[segment + 1].x()) {
+                segment++;
+            }
+            const QPointF& p0 = points[segment];
+            const QPointF& p1 = points[segment + 1];
+            const double h = qMax(1e-6, p1.x() - p0.x());
+            const double t = qBound(0.0, (i - p0.x()) / h, 1.0);
+            const double t2 = t * t;
+            const double t3 = t2 * t;
+            const double y = (2 * t3 - 3 * t2 + 1) * p0.y() + (t3 - 2 * t2 + t) * h * tangents[segment]
+                           + (-2 * t3 + 3 * t2) * p1.y() + (t3 - t2) * h * tangents[segment + 1];
+            lut[i] = qBound(0, qRound(y), 255);
+        }
+        return lut;
+    }
+
+    Lut composeLut(const Lut& first, const Lut& second) {
+        if (first.isEmpty())
+            return second;
+        if (second.isEmpty())
+            return first;
+
+        Lut lut(256);
+        for (int i = 0; i < 256; i++) {
+            lut[i] = second[first[i]];
+        }
+        return lut;
+    }
+
+    bool isIdentity(const Lut& lut) {
+        for (int i = 0; i < lut.size(); i++) {
+            if (lut[i] != i)
+                return false;
+        }
+        return true;
+    }
+
+    QImage applyLut(const QImage& input, const Lut& lut) {
+        if (lut.isEmpty() || input.isNull())
+            return input;
+
+        // palette images only need their colour table mapped
+        if (input.format() == QImage::Format_Indexed8 || input.format() == QImage::Format_Mono
+                || input.format() == QImage::Format_MonoLSB) {
+            QImage res = input.copy();
+            QVector<QRgb> table = res.colorTable();
+            for (auto& color : table) {
+                color = qRgba(lut[qRed(color)], lut[qGreen(color)], lut[qBlue(color)], qAlpha(color));
+            }
+            res.setColorTable(table);
+            return res;
+        }
+
+        // premultiplied colour is mapped unpremultiplied
+        const QImage image = toByteChannels(input);
+
+        const int channels = image.depth() / 8;
+        const int alpha = channels == 4 ? alphaByteIndex() : -1;
+        QImage res = pooledImage(image.size(), image.format());
+
+        const ImageRows resRows(res);
+        parallelBands(image.height(), [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                const quint8 *src = image.constScanLine(y);
+                quint8 *dst = resRows[y];
+                const int bytes = image.width() * channels;
+                for (int i = 0; i < bytes; i++) {
+                    dst[i] = lut[src[i]];
+                }
+                if (alpha >= 0) {
+                    for (int i = alpha; i < bytes; i += 4) {
+                        dst[i] = src[i];
+                    }
+                }
+            }
+        }, 64);
+
+        if (input.format() == QImage::Format_ARGB32_Premultiplied)
+            return res.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        return res;
+    }
+
+    QImage clahe(const QImage& image, int tiles, double clipLimit) {
+        const int width = image.width();
+        const int height = image.height();
+        tiles = qBound(1, tiles, qMax(1, qMin(width, height) / 8));
+        const int tileWidth = (width + tiles - 1) / tiles;
+        const int tileHeight = (height + tiles - 1) / tiles;
+
+        // equalization table per tile
+        std::vector<Lut> maps(tiles * tiles);
+        parallelBands(tiles * tiles, [&](int begin, int end) {
+            for (int t = begin; t < end; t++) {
+                const QRect rect = QRect((t % tiles) * tileWidth, (t / tiles) * tileHeight, tileWidth, tileHeight)
+                        .intersected(image.rect());
+                quint32 bins[256] = { 0 };
+                for (int y = rect.top(); y <= rect.bottom(); y++) {
+                    const quint8 *line = image.constScanLine(y);
+                    for (int x = rect.left(); x <= rect.right(); x++) {
+                        bins[line[x]]++;
+                    }
+                }
+
+                // clip and spread the excess evenly over all bins
+                const qint64 pixels = qint64(rect.width()) * rect.height();
+                const quint32 limit = qMax<quint32>(1, quint32(clipLimit * pixels / 256));
+                qint64 excess = 0;
+                for (int i = 0; i < 256; i++) {
+                    if (bins[i] > limit) {
+                        excess += bins[i] - limit;
+                        bins[i] = limit;
+                    }
+                }
+                for (int i = 0; i < 256; i++) {
+                    bins[i] += quint32(excess / 256 + (i < excess % 256 ? 1 : 0));
+                }
+
+                Lut& map = maps[t];
+                map.resize(256);
+                qint64 sum = 0;
+                for (int i = 0; i < 256; i++) {
+                    sum += bins[i];
+                    map[i] = quint8(qBound<qint64>(0, (sum * 255 + pixels / 2) / qMax<qint64>(1, pixels), 255));
+                }
+            }
+        }, 1);
+
+        QImage res = pooledImage(image.size(), QImage::Format_Grayscale8);
+        const ImageRows resRows(res);
+        parallelBands(height, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                // neighbouring tile rows and weight, by distance to tile centres
+                const double fy = (y + 0.5) / tileHeight - 0.5;
+                const int ty0 = qBound(0, int(std::floor(fy)), tiles - 1);
+                const int ty1 = qMin(ty0 + 1, tiles - 1);
+                const double wy = qBound(0.0, fy - ty0, 1.0);
+                const quint8 *src = image.constScanLine(y);
+                quint8 *dst = resRows[y];
+
+                for (int x = 0; x < width; x++) {
+                    const double fx = (x + 0.5) / tileWidth - 0.5;
+                    const int tx0 = qBound(0, int(std::floor(fx)), tiles - 1);
+                    const int tx1 = qMin(tx0 + 1, tiles - 1);
+                    const double wx = qBound(0.0, fx - tx0, 1.0);
+                    const quint8 v = src[x];
+
+                    const double top = (1 - wx) * maps[ty0 * tiles + tx0][v] + wx * maps[ty0 * tiles + tx1][v];
+                    const double bottom = (1 - wx) * maps[ty1 * tiles + tx0][v] + wx * maps[ty1 * tiles + tx1][v];
+                    dst[x] = qRound((1 - wy) * top + wy * bottom);
+                }
+            }
+        });
+
+        return res;
+    }
+}
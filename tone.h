@@ -0,0 +1,38 @@
+#ifndef TONE_H
+#define TONE_H
+
+#include <QImage>
+#include <QPointF>
+#include <QVector>
+
+namespace algorithms
+{
+    // 256 entry lookup table applied to every colour channel, empty for identity
+    typedef QVector<quint8> Lut;
+
+    struct Histogram {
+        quint32 luma[256];
+        quint32 red[256];
+        quint32 green[256];
+        quint32 blue[256];
+    };
+
+    // per thread histograms of row bands, merged at the end
+    Histogram histogram(const QImage&);
+
+    Lut levelsLut(int black, int white, double gamma);
+    // monotone cubic through the control points, x and y in 0..255
+    Lut curveLut(QVector<QPointF> points);
+    // second applied after first
+    Lut composeLut(const Lut& first, const Lut& second);
+    bool isIdentity(const Lut&);
+
+    QImage applyLut(const QImage&, const Lut&);
+
+    // Contrast limited adaptive histogram equalization of a Grayscale8 image:
+    // tiles x tiles equalization tables clipped at clipLimit times the mean
+    // bin, bilinearly blended between tile centres.
+    QImage clahe(const QImage&, int tiles, double clipLimit);
+}
+
+#endif // TONE_H
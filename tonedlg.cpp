@@ -0,0 +1,100 @@
+#include "tonedlg.h"
+#include "ui_tonedlg.h"
+
+ToneDlg::ToneDlg(const algorithms::Histogram& histogram, const algorithms::Lut& base, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::ToneDlg),
+    m_base(base)
+{
+    ui->setupUi(this);
+    this->setWindowFlags(this->windowFlags() & ~Qt::WindowContextHelpButtonHint);
+
+    ui->histogram->setHistogram(histogram);
+
+    connect(ui->blackSlider, SIGNAL(valueChanged(int)), this, SLOT(onSliderChanged()));
+    connect(ui->whiteSlider, SIGNAL(valueChanged(int)), this, SLOT(onSliderChanged()));
+    connect(ui->gammaSlider, SIGNAL(valueChanged(int)), this, SLOT(onSliderChanged()));
+    connect(ui->shadowsSlider, SIGNAL(valueChanged(int)), this, SLOT(onSliderChanged()));
+    connect(ui->midtonesSlider, SIGNAL(valueChanged(int)), this, SLOT(onSliderChanged()));
+    connect(ui->highlightsSlider, SIGNAL(valueChanged(int)), this, SLOT(onSliderChanged()));
+    connect(ui->resetButton, SIGNAL(clicked()), this, SLOT(resetAdjustments()));
+    connect(ui->claheButton, SIGNAL(clicked()), this, SLOT(onClaheClicked()));
+
+    onSliderChanged();
+}
+
+ToneDlg::~ToneDlg()
+{
+    delete ui;
+}
+
+// gamma slider works in hundredths, curve sliders move the points at 64, 128 and 192
+algorithms::Lut ToneDlg::lut() const
+{
+    algorithms::Lut levels = algorithms::levelsLut(ui->blackSlider->value(), ui->whiteSlider->value(),
+                                                   ui->gammaSlider->value() / 100.0);
+    algorithms::Lut curve = algorithms::curveLut(QVector<QPointF>()
+            << QPointF(64, 64 + ui->shadowsSlider->value())
+            << QPointF(128, 128 + ui->midtonesSlider->value())
+            << QPointF(192, 192 + ui->highlightsSlider->value()));
+
+    algorithms::Lut lut = algorithms::composeLut(m_base, algorithms::composeLut(levels, curve));
+    return algorithms::isIdentity(lut) ? algorithms::Lut() : lut;
+}
+
+void ToneDlg::setHistogram(const algorithms::Histogram& histogram)
+{
+    ui->histogram->setHistogram(histogram);
+}
+
+void ToneDlg::resetAdjustments()
+{
+    ui->blackSlider->setValue(0);
+    ui->whiteSlider->setValue(255);
+    ui->gammaSlider->setValue(100);
+    ui->shadowsSlider->setValue(0);
+    ui->midtonesSlider->setValue(0);
+    ui->highlightsSlider->setValue(0);
+}
+
+// Cancel brings back the adjustment the view had before
+void ToneDlg::reject()
+{
+    emit lutChanged(m_base);
+    QDialog::reject();
+}
+
+void ToneDlg::onSliderChanged()
+{
+    // keep the black point below the white one
+    if (ui->blackSlider->value() >= ui->whiteSlider->value()) {
+        QObject* obj = sender();
+        if (obj == ui->blackSlider) {
+            ui->whiteSlider->setValue(ui->blackSlider->value() + 1);
+        } else {
+            ui->blackSlider->setValue(ui->whiteSlider->value() - 1);
+        }
+        return;
+    }
+
+    ui->blackValue->setText(QString::number(ui->blackSlider->value()));
+    ui->whiteValue->setText(QString::number(ui->whiteSlider->value()));
+    ui->gammaValue->setText(QString::number(ui->gammaSlider->value() / 100.0, 'f', 2));
+    ui->shadowsValue->setText(QString::number(ui->shadowsSlider->value()));
+    ui->midtonesValue->setText(QString::number(ui->midtonesSlider->value()));
+    ui->highlightsValue->setText(QString::number(ui->highlightsSlider->value()));
+
+    algorithms::Lut lut = this->lut();
+    ui->histogram->setLut(lut);
+    emit lutChanged(lut);
+}
+
+// the current adjustment is baked into the image before equalizing,
+// so the dialog starts over from the new image
+void ToneDlg::onClaheClicked()
+{
+    emit claheRequested();
+    m_base = algorithms::Lut();
+    resetAdjustments();
+    onSliderChanged();
+}
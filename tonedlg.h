@@ -0,0 +1,43 @@
+#ifndef TONEDLG_H
+#define TONEDLG_H
+
+#include <QDialog>
+#include "tone.h"
+
+namespace Ui {
+class ToneDlg;
+}
+
+// Levels, gamma and a three point curve, previewed through the view's tile
+// LUT while the sliders move. CLAHE is not a point operation and is applied
+// to the image right away.
+class ToneDlg : public QDialog
+{
+    Q_OBJECT
+
+public:
+    // base is the adjustment the view already shows, the dialog adds to it
+    ToneDlg(const algorithms::Histogram& histogram, const algorithms::Lut& base, QWidget *parent = 0);
+    ~ToneDlg();
+
+    algorithms::Lut lut() const;
+    void setHistogram(const algorithms::Histogram& histogram);
+
+signals:
+    void lutChanged(const QVector<quint8>& lut);
+    void claheRequested();
+
+public slots:
+    void resetAdjustments();
+    virtual void reject();
+
+private slots:
+    void onSliderChanged();
+    void onClaheClicked();
+
+private:
+    Ui::ToneDlg *ui;
+    algorithms::Lut m_base;
+};
+
+#endif // TONEDLG_H